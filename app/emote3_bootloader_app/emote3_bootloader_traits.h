@@ -60,6 +60,15 @@ template<> struct Traits<Heaps>: public Traits<void>
 {
     static const bool debugged = hysterically_debugged;
 };
+
+template<> struct Traits<Bignums>: public Traits<void>
+{
+    // Bytes per Bignum digit: 4 or 8 (8 needs a compiler with a 128-bit integer type, e.g. on x86-64 hosts)
+    static const unsigned int DIGIT_SIZE = 4;
+
+    // Fully unroll the kernels of Bignums of up to 16 digits (faster, but costs flash; false shares loops among all sizes)
+    static const bool UNROLLED = true;
+};
 template <> struct Traits<Bignum> : public Traits<void>
 {
     static const bool enabled = false;
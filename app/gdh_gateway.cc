@@ -44,18 +44,10 @@ int main()
 
 	cout << "Group id = " << g_id << endl;
 
-    GPIO g('C',3, GPIO::OUT); //led
-	bool b = false;
-
-	Group_Diffie_Hellman::Shared_Key init_value;
-	while(TSTP::GDH_Security::key() == init_value) {
-		//b = !b;
-		//g.set(b); //blink the led
-		for(volatile int t=0;t<0xfffff;t++);
-		cout << "current key: " << TSTP::GDH_Security::key() << endl;
-	}
-
-	cout << "Shared key = " << TSTP::GDH_Security::key() << endl;
+	if(TSTP::GDH_Security::wait_key(g_id))
+		cout << "Shared key = " << TSTP::GDH_Security::key(g_id) << endl;
+	else
+		cout << "Group key agreement failed!" << endl;
 
     Thread::self()->suspend();
 
@@ -0,0 +1,274 @@
+#ifndef __traits_h
+#define __traits_h
+
+#include <system/config.h>
+
+__BEGIN_SYS
+
+// Global Configuration
+template<typename T>
+struct Traits
+{
+    static const bool enabled = true;
+    static const bool debugged = true;
+    static const bool hysterically_debugged = false;
+    typedef TLIST<> ASPECTS;
+};
+
+template<> struct Traits<Build>
+{
+    enum {LIBRARY, BUILTIN, KERNEL};
+    static const unsigned int MODE = LIBRARY;
+
+    enum {IA32, ARMv7};
+    static const unsigned int ARCHITECTURE = ARMv7;
+
+    enum {PC, Cortex};
+    static const unsigned int MACHINE = Cortex;
+
+    enum {Legacy_PC, eMote3, LM3S811, Zynq};
+    static const unsigned int MODEL = eMote3;
+
+    static const unsigned int CPUS = 1;
+    static const unsigned int NODES = 1; // > 1 => NETWORKING
+};
+
+
+// Utilities
+template<> struct Traits<Debug>
+{
+    static const bool error   = true;
+    static const bool warning = true;
+    static const bool info    = false;
+    static const bool trace   = false;
+};
+
+template<> struct Traits<Lists>: public Traits<void>
+{
+    static const bool debugged = hysterically_debugged;
+};
+
+template<> struct Traits<Spin>: public Traits<void>
+{
+    static const bool debugged = hysterically_debugged;
+};
+
+template<> struct Traits<Heaps>: public Traits<void>
+{
+    static const bool debugged = hysterically_debugged;
+};
+
+template<> struct Traits<Bignums>: public Traits<void>
+{
+    // Bytes per Bignum digit: 4 or 8 (8 needs a compiler with a 128-bit integer type, e.g. on x86-64 hosts)
+    static const unsigned int DIGIT_SIZE = 4;
+
+    // Fully unroll the kernels of Bignums of up to 16 digits (faster, but costs flash; false shares loops among all sizes)
+    static const bool UNROLLED = true;
+};
+
+template<> struct Traits<Observers>: public Traits<void>
+{
+    // Some observed objects are created before initializing the Display
+    // Enabling debug may cause trouble in some Machines
+    static const bool debugged = false;
+};
+
+// System Parts (mostly to fine control debugging)
+template<> struct Traits<Boot>: public Traits<void>
+{
+};
+
+template<> struct Traits<Setup>: public Traits<void>
+{
+};
+
+template<> struct Traits<Init>: public Traits<void>
+{
+};
+
+
+// Mediators
+template<> struct Traits<Serial_Display>: public Traits<void>
+{
+    static const bool enabled = true;
+    enum {UART, USB};
+    static const int ENGINE = USB;
+    static const int COLUMNS = 80;
+    static const int LINES = 24;
+    static const int TAB_SIZE = 8;
+};
+
+template<> template <unsigned int S> struct Traits<Software_AES<S>>: public Traits<void>
+{
+    static const bool enabled = true;
+    static const unsigned int KEY_SIZE = 16;
+};
+
+template<> struct Traits<Group_Diffie_Hellman_Parameters>: public Traits<void>
+{
+    // Group used by TSTP's GDH_Security: 32 (toy), 128, 256, 1024, 1536, 2048 or 3072 bits
+    // TSTP round keys must fit in a frame, so only groups up to 128 bits work over the radio
+    static const unsigned int BITS = 32;
+
+    // Constant-time exponentiations (Montgomery ladder): the same cost for any key, so rekeying fits a fixed
+    // TSTP MAC slot without jitter, at about twice the time of the default sliding window
+    static const bool CONSTANT_TIME = false;
+};
+
+__END_SYS
+
+#include __ARCH_TRAITS_H
+#include __MACH_TRAITS_H
+
+__BEGIN_SYS
+
+
+// Components
+template<> struct Traits<Application>: public Traits<void>
+{
+    static const unsigned int STACK_SIZE = Traits<Machine>::STACK_SIZE;
+    static const unsigned int HEAP_SIZE = Traits<Machine>::HEAP_SIZE;
+    static const unsigned int MAX_THREADS = Traits<Machine>::MAX_THREADS;
+};
+
+template<> struct Traits<System>: public Traits<void>
+{
+    static const unsigned int mode = Traits<Build>::MODE;
+    static const bool multithread = (Traits<Application>::MAX_THREADS > 1);
+    static const bool multitask = (mode != Traits<Build>::LIBRARY);
+    static const bool multicore = (Traits<Build>::CPUS > 1) && multithread;
+    static const bool multiheap = (mode != Traits<Build>::LIBRARY) || Traits<Scratchpad>::enabled;
+
+    enum {FOREVER = 0, SECOND = 1, MINUTE = 60, HOUR = 3600, DAY = 86400, WEEK = 604800, MONTH = 2592000, YEAR = 31536000};
+    static const unsigned long LIFE_SPAN = 1 * HOUR; // in seconds
+    static const unsigned int DUTY_CYCLE = 10000; // in ppm
+
+    static const bool reboot = true;
+
+    static const unsigned int STACK_SIZE = Traits<Machine>::STACK_SIZE;
+    static const unsigned int HEAP_SIZE = (Traits<Application>::MAX_THREADS + 1) * Traits<Application>::STACK_SIZE;
+};
+
+template<> struct Traits<Task>: public Traits<void>
+{
+    static const bool enabled = Traits<System>::multitask;
+};
+
+template<> struct Traits<Thread>: public Traits<void>
+{
+    static const bool smp = Traits<System>::multicore;
+
+    typedef Scheduling_Criteria::RM Criterion;
+    static const unsigned int QUANTUM = 10000; // us
+
+    static const bool trace_idle = hysterically_debugged;
+};
+
+template<> struct Traits<Scheduler<Thread> >: public Traits<void>
+{
+    static const bool debugged = Traits<Thread>::trace_idle || hysterically_debugged;
+};
+
+template<> struct Traits<Periodic_Thread>: public Traits<void>
+{
+    static const bool simulate_capacity = false;
+};
+
+template<> struct Traits<Address_Space>: public Traits<void>
+{
+    static const bool enabled = Traits<System>::multiheap;
+};
+
+template<> struct Traits<Segment>: public Traits<void>
+{
+    static const bool enabled = Traits<System>::multiheap;
+};
+
+template<> struct Traits<Alarm>: public Traits<void>
+{
+    static const bool visible = hysterically_debugged;
+};
+
+template<> struct Traits<Synchronizer>: public Traits<void>
+{
+    static const bool enabled = Traits<System>::multithread;
+};
+
+template<> struct Traits<Network>: public Traits<void>
+{
+    static const bool enabled = (Traits<Build>::NODES > 1);
+
+    static const unsigned int RETRIES = 3;
+    static const unsigned int TIMEOUT = 10; // s
+
+    // This list is positional, with one network for each NIC in Traits<NIC>::NICS
+    typedef LIST<IP> NETWORKS;
+};
+
+template<> struct Traits<ELP>: public Traits<Network>
+{
+    static const bool enabled = NETWORKS::Count<ELP>::Result;
+
+    static const bool acknowledged = true;
+};
+
+template<> struct Traits<TSTP>: public Traits<Network>
+{
+    static const bool enabled = NETWORKS::Count<TSTP>::Result;
+    static const bool sink = false;
+};
+
+template<> template <typename S> struct Traits<Smart_Data<S>>: public Traits<Network>
+{
+    static const bool enabled = NETWORKS::Count<TSTP>::Result;
+};
+
+template<> struct Traits<IP>: public Traits<Network>
+{
+    static const bool enabled = NETWORKS::Count<IP>::Result;
+
+    enum {STATIC, MAC, INFO, RARP, DHCP};
+
+    struct Default_Config {
+        static const unsigned int  TYPE    = DHCP;
+        static const unsigned long ADDRESS = 0;
+        static const unsigned long NETMASK = 0;
+        static const unsigned long GATEWAY = 0;
+    };
+
+    template<unsigned int UNIT>
+    struct Config: public Default_Config {};
+
+    static const unsigned int TTL  = 0x40; // Time-to-live
+};
+
+template<> struct Traits<IP>::Config<0> //: public Traits<IP>::Default_Config
+{
+    static const unsigned int  TYPE      = MAC;
+    static const unsigned long ADDRESS   = 0x0a000100;  // 10.0.1.x x=MAC[5]
+    static const unsigned long NETMASK   = 0xffffff00;  // 255.255.255.0
+    static const unsigned long GATEWAY   = 0;           // 10.0.1.1
+};
+
+template<> struct Traits<IP>::Config<1>: public Traits<IP>::Default_Config
+{
+};
+
+template<> struct Traits<UDP>: public Traits<Network>
+{
+    static const bool checksum = true;
+};
+
+template<> struct Traits<TCP>: public Traits<Network>
+{
+    static const unsigned int WINDOW = 4096;
+};
+
+template<> struct Traits<DHCP>: public Traits<Network>
+{
+};
+
+__END_SYS
+
+#endif
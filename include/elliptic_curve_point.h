@@ -18,6 +18,10 @@ public:
 
   void operator*=(const Coordinate & b);
 
+  // Meant for normalized points (z = 1), which is how operator*= leaves them
+  bool operator==(const Elliptic_Curve_Point & b) const { return (x == b.x) && (y == b.y) && (z == b.z); }
+  bool operator!=(const Elliptic_Curve_Point & b) const { return !(*this == b); }
+
   friend Debug &operator<<(Debug &out, const Elliptic_Curve_Point &a) {
     out << "{x=" << a.x << ",y=" << a.y << ",z=" << a.z << "}";
     return out;
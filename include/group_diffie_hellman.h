@@ -6,15 +6,34 @@
 #include <system/config.h>
 #include <utility/ostream.h>
 #include <utility/malloc.h>
+#include <utility/bignum.h>
+#include <utility/random.h>
+#include <elliptic_curve_point.h>
 
 __BEGIN_SYS
 
-class Group_Diffie_Hellman
+// Group Diffie-Hellman over the multiplicative group of integers modulo a BITS-wide prime q.
+// Numbers are little-endian _UTIL::Bignum digit vectors (the Bignum's own static modulus is not used)
+// and every exponentiation runs in the Montgomery domain of q.
+// Default parameters are provided for BITS = 32 (toy group), for 128- and 256-bit safe prime groups and for
+// the RFC 3526 MODP groups (BITS = 1024, 1536, 2048 and 3072, 1024 being RFC 2409's Oakley Group 2).
+// Their Montgomery constants are precomputed, so only custom parameters pay for montgomery_setup() at runtime.
+// Traits<Group_Diffie_Hellman_Parameters>::BITS selects the group used by the rest of the system (e.g. TSTP).
+template<unsigned int BITS>
+class Group_Diffie_Hellman_Common
 {
-private:
-	typedef unsigned long long Number;
+protected:
+	typedef _UTIL::Bignum<BITS / 8> Number;
+	typedef typename Number::Digit Digit;
+	typedef typename Number::Double_Digit Double_Digit;
+
+	static const unsigned int DIGITS = Number::DIGITS;
+	static const unsigned int BITS_PER_DIGIT = Number::BITS_PER_DIGIT;
 
 public:
+	static const unsigned int KEY_SIZE = sizeof(Number);
+	static const unsigned int DEFAULT_WINDOW = (BITS > 239) ? 5 : (BITS > 79) ? 4 : (BITS > 23) ? 3 : 1;
+
 	typedef Number Round_Key;
 	typedef Number Private_Key;
 	typedef Number Shared_Key;
@@ -27,114 +46,904 @@ public:
 			Parameters(const Parameters& params) : _base(params.base()), _q(params.q()) {}
 			Parameters(const Number& base, const Number& q) : _base(base), _q(q) {}
 
-			Number base() const { return _base; }
-			Number q() const { return _q; }
+			const Number & base() const { return _base; }
+			const Number & q() const { return _q; }
 
 			friend OStream & operator<<(OStream & db, const Parameters & m) {
 				db << "(Parameters base=" << m._base << ", q=" << m._q << ")";
 				return db;
 			}
+			friend Debug & operator<<(Debug & db, const Parameters & m) {
+				db << "(Parameters base=" << m._base << ", q=" << m._q << ")";
+				return db;
+			}
 	};
 
+public:
+	static Parameters default_parameters() {
+		return Parameters(Number(_default_base), Number(_default_q, KEY_SIZE));
+	}
+
+protected:
+	Group_Diffie_Hellman_Common() {}
+
+	// Random exponent in [3, q - 2] that is coprime with q - 1, along with its inverse modulo q - 1
+	// (checking coprimality already yields the inverse, so remove_key() gets it for free)
+	static void generate_private_key(Private_Key & key, Private_Key & inverse, const Number & q) {
+		Number order(q);
+		decrement(order);
+
+		int top;
+		for(top = DIGITS - 1; (top > 0) && (order[top] == 0); top--);
+
+		do {
+			for(int i = DIGITS - 1; i > top; i--)
+				key._data[i] = 0;
+			key._data[top] = Number::random_digit() % order[top];
+			for(int i = top - 1; i >= 0; i--)
+				key._data[i] = Number::random_digit();
+			key._data[0] |= 1; // q - 1 is even, so an even exponent is never invertible
+		} while((key == Number(1)) || !mod_inv(inverse, key, order));
+	}
+
+	// Montgomery constants for q: n0 = -(q^(-1)) % base and r2 = R^2 % q, with R = base^DIGITS
+	// The tables assume R = 2^BITS, which does not hold when BITS is not a whole number of digits (e.g. 32-bit q, 64-bit digits)
+	static void montgomery_setup(Number & r2, Digit & n0, const Number & q) {
+		if((BITS % BITS_PER_DIGIT == 0) && (q == Number(_default_q, KEY_SIZE))) {
+			r2 = Number(_default_r2, KEY_SIZE);
+			n0 = Digit(_default_n0); // -(q^(-1)) % 2^64 truncated to a Digit
+			return;
+		}
+		montgomery_compute(r2, n0, q);
+	}
+
+	static void montgomery_compute(Number & r2, Digit & n0, const Number & q) {
+		n0 = -Number::digit_inverse(q[0]);
+
+		r2 = 1;
+		for(unsigned int i = 0; i < 2 * DIGITS * BITS_PER_DIGIT; i++)
+			if(Number::simple_add(r2._data, r2._data, r2._data, DIGITS) || (Number::cmp(r2._data, q._data, DIGITS) >= 0))
+				Number::simple_sub(r2._data, r2._data, q._data, DIGITS);
+	}
+
+	// res = (a * b * R^(-1)) % q
+	static void montgomery_mult(Number & res, const Number & a, const Number & b, const Number & q, Digit n0) {
+		Number::montgomery_mult(res._data, a._data, b._data, q._data, n0, DIGITS);
+	}
+
+	// res = a^(-1) % m, with a odd and m even (m = 2^s * o, o odd)
+	// The inverse is computed modulo o and modulo 2^s separately and then combined (CRT)
+	// Returns false if the inverse does not exist
+	static bool mod_inv(Number & res, const Number & a, const Number & m) {
+		Number o(m);
+		unsigned int s;
+		for(s = 0; !(o[0] & 1); s++)
+			shift_right(o);
+
+		Number inv_o;
+		if(!odd_mod_inv(inv_o, a, o))
+			return false;
+
+		// j = ((a^(-1) - inv_o) * o^(-1)) % 2^s
+		Number a_inv, o_inv, j;
+		two_adic_inv(a_inv, a);
+		two_adic_inv(o_inv, o);
+		Number::simple_sub(a_inv._data, a_inv._data, inv_o._data, DIGITS);
+		mult_low(j, a_inv, o_inv);
+		for(unsigned int i = 0; i < DIGITS; i++) {
+			if(i * BITS_PER_DIGIT >= s)
+				j._data[i] = 0;
+			else if((i + 1) * BITS_PER_DIGIT > s)
+				j._data[i] &= (Digit(1) << (s - i * BITS_PER_DIGIT)) - 1;
+		}
+
+		// res = inv_o + o * j < m
+		mult_low(res, o, j);
+		Number::simple_add(res._data, res._data, inv_o._data, DIGITS);
+
+		return true;
+	}
+
+	// res = a^(-1) % m, with m odd (binary extended Euclidean algorithm, the same as in Bignum::invert())
+	static bool odd_mod_inv(Number & res, const Number & a, const Number & m) {
+		Number u(a), v(m), A(1), zero(0);
+		res = 0;
+		while(u != zero) {
+			while(!(u[0] & 1)) {
+				shift_right(u);
+				half_mod(A, m);
+			}
+			while(!(v[0] & 1)) {
+				shift_right(v);
+				half_mod(res, m);
+			}
+			if(u >= v) {
+				Number::simple_sub(u._data, u._data, v._data, DIGITS);
+				if(Number::simple_sub(A._data, A._data, res._data, DIGITS))
+					Number::simple_add(A._data, A._data, m._data, DIGITS);
+			} else {
+				Number::simple_sub(v._data, v._data, u._data, DIGITS);
+				if(Number::simple_sub(res._data, res._data, A._data, DIGITS))
+					Number::simple_add(res._data, res._data, m._data, DIGITS);
+			}
+		}
+		return v == Number(1);
+	}
+
+	// res = a^(-1) % base^DIGITS, with a odd (Newton-Hensel lifting)
+	static void two_adic_inv(Number & res, const Number & a) {
+		res = Number::digit_inverse(a[0]);
+		for(unsigned int bits = BITS_PER_DIGIT; bits < DIGITS * BITS_PER_DIGIT; bits *= 2) {
+			// res = res * (2 - a * res)
+			Number t, two(2);
+			mult_low(t, a, res);
+			Number::simple_sub(t._data, two._data, t._data, DIGITS);
+			mult_low(res, res, t);
+		}
+	}
+
+	// res = (a * b) % base^DIGITS
+	static void mult_low(Number & res, const Number & a, const Number & b) {
+		Digit product[2 * DIGITS];
+		Number::simple_mult(product, a._data, b._data, DIGITS);
+		for(unsigned int i = 0; i < DIGITS; i++)
+			res._data[i] = product[i];
+	}
+
+	// n = (n / 2) % m, with m odd
+	static void half_mod(Number & n, const Number & m) {
+		bool carry = (n[0] & 1) ? Number::simple_add(n._data, n._data, m._data, DIGITS) : false;
+		shift_right(n, carry);
+	}
+
+	static void shift_right(Number & n, bool carry = false) {
+		for(int i = DIGITS - 1; i >= 0; i--) {
+			bool next_carry = n._data[i] & 1;
+			n._data[i] = (n._data[i] >> 1) | (Digit(carry) << (BITS_PER_DIGIT - 1));
+			carry = next_carry;
+		}
+	}
+
+	static void decrement(Number & n) {
+		Number one(1);
+		Number::simple_sub(n._data, n._data, one._data, DIGITS);
+	}
+
+	static bool bit(const Number & n, unsigned int i) {
+		return (n[i / BITS_PER_DIGIT] >> (i % BITS_PER_DIGIT)) & 1;
+	}
+
+	// Swaps a and b if swap is 1 (and leaves them alone if it is 0) without branching on it
+	static void conditional_swap(Number & a, Number & b, Digit swap) {
+		Digit mask = -swap;
+		for(unsigned int i = 0; i < DIGITS; i++) {
+			Digit t = (a._data[i] ^ b._data[i]) & mask;
+			a._data[i] ^= t;
+			b._data[i] ^= t;
+		}
+	}
+
 private:
-	Private_Key generate_private_key(const Number& q) const;
+	static const unsigned int _default_base;
+	static const unsigned char _default_q[KEY_SIZE];
+	static const unsigned char _default_r2[KEY_SIZE];
+	static const unsigned long long _default_n0;
+};
 
-	Parameters _parameters;
-	Private_Key _private_key;
+// Fixed-base comb (Lim-Lee) for exponentiations of Parameters::base(): the exponent is split into TEETH
+// rows of SPACING bits and table[m - 1] holds the product of base^(2^(j * SPACING)) for each bit j set in m,
+// so base^e takes SPACING - 1 squarings and at most SPACING multiplications.
+// Only the default parameters (the Traits group) have a table, one per instantiation, built once by precompute().
+// Call it before any thread shares the instantiation (TSTP's bootstrap does): the table is only read afterwards.
+// Until then, and for any other parameters, exponentiations fall back to the sliding window.
+// TABLE_SIZE gives its RAM cost in bytes. TEETH = 0 disables it.
+template<unsigned int BITS, unsigned int TEETH>
+class Group_Diffie_Hellman_Comb: public Group_Diffie_Hellman_Common<BITS>
+{
+protected:
+	typedef Group_Diffie_Hellman_Common<BITS> Base;
+	typedef typename Base::Number Number;
+	typedef typename Base::Digit Digit;
+	typedef typename Base::Parameters Parameters;
+
+	static const unsigned int ENTRIES = (1 << TEETH) - 1;
+	static const unsigned int SPACING = (BITS + TEETH - 1) / TEETH;
 
 public:
-	Group_Diffie_Hellman(const Parameters & params) :
-		_parameters(params),
-		_private_key(generate_private_key(params.q()))
-	{}
+	static const unsigned int TABLE_SIZE = ENTRIES * Base::KEY_SIZE;
+
+	// Builds the table for the default parameters (only the first call does anything)
+	static void precompute() {
+		if(_built)
+			return;
+
+		Parameters parameters = Base::default_parameters();
+		Number r2;
+		Digit n0;
+		Base::montgomery_setup(r2, n0, parameters.q());
+		build(parameters, r2, n0);
+		_built = true;
+	}
+
+protected:
+	// res = (base ^ exponent) % q, in the Montgomery domain
+	// Returns false, leaving res untouched, if there is no table for the parameters
+	static bool fixed_base_exp(Number & res, const Parameters & parameters, const Number & exponent, const Number & r2, const Digit & n0) {
+		if(!_built)
+			return false;
+		Parameters defaults = Base::default_parameters();
+		if(!(parameters.q() == defaults.q()) || !(parameters.base() == defaults.base()))
+			return false;
+		const Number & q = parameters.q();
 
-	Group_Diffie_Hellman() :
-		_parameters(7, 767410129),
-		_private_key(generate_private_key(767410129))
-	{}
+		bool one = true;
+		for(int column = SPACING - 1; column >= 0; column--) {
+			if(!one)
+				Base::montgomery_mult(res, res, res, q, n0);
 
-	Parameters parameters() const { return _parameters; }
-	Private_Key private_key() const { return _private_key; }
+			unsigned int m = 0;
+			for(unsigned int j = 0; j < TEETH; j++)
+				if((j * SPACING + column < BITS) && Base::bit(exponent, j * SPACING + column))
+					m |= 1 << j;
+
+			if(m) {
+				if(one) {
+					res = _table[m - 1];
+					one = false;
+				} else
+					Base::montgomery_mult(res, res, _table[m - 1], q, n0);
+			}
+		}
 
-	Round_Key insert_key() const;
-	Round_Key insert_key(Round_Key round_key) const;
-	Round_Key remove_key(Round_Key round_key) const;
+		if(one)
+			res = r2; // R^2 * R^(-1) = R, the Montgomery representation of 1
+		return true;
+	}
 
 private:
+	static void build(const Parameters & parameters, const Number & r2, const Digit & n0) {
+		db<Diffie_Hellman>(TRC) << "Group_Diffie_Hellman_Comb::build(p=" << parameters << ")" << endl;
 
-	Round_Key inverted_private_key() const
-	{
-		return mod_inv(_private_key, _parameters.q()-1);
+		const Number & q = parameters.q();
+
+		// table[2^j - 1] = base^(2^(j * SPACING))
+		Base::montgomery_mult(_table[0], parameters.base(), r2, q, n0);
+		for(unsigned int j = 1; j < TEETH; j++) {
+			_table[(1 << j) - 1] = _table[(1 << (j - 1)) - 1];
+			for(unsigned int i = 0; i < SPACING; i++)
+				Base::montgomery_mult(_table[(1 << j) - 1], _table[(1 << j) - 1], _table[(1 << j) - 1], q, n0);
+		}
+
+		// table[m - 1] = table[(m without its lowest bit) - 1] * table[(lowest bit of m) - 1]
+		for(unsigned int m = 3; m <= ENTRIES; m++) {
+			unsigned int low = m & -m;
+			if(low != m)
+				Base::montgomery_mult(_table[m - 1], _table[(m - low) - 1], _table[low - 1], q, n0);
+		}
+	}
+
+private:
+	static bool _built;
+	static Number _table[ENTRIES];
+};
+
+template<unsigned int BITS>
+class Group_Diffie_Hellman_Comb<BITS, 0>: public Group_Diffie_Hellman_Common<BITS>
+{
+protected:
+	typedef Group_Diffie_Hellman_Common<BITS> Base;
+	typedef typename Base::Number Number;
+	typedef typename Base::Digit Digit;
+	typedef typename Base::Parameters Parameters;
+
+public:
+	static const unsigned int TABLE_SIZE = 0;
+
+	static void precompute() {}
+
+protected:
+	static bool fixed_base_exp(Number & res, const Parameters & parameters, const Number & exponent, const Number & r2, const Digit & n0) { return false; }
+};
+
+template<unsigned int BITS, unsigned int TEETH>
+bool Group_Diffie_Hellman_Comb<BITS, TEETH>::_built = false;
+
+template<unsigned int BITS, unsigned int TEETH>
+typename Group_Diffie_Hellman_Comb<BITS, TEETH>::Number Group_Diffie_Hellman_Comb<BITS, TEETH>::_table[Group_Diffie_Hellman_Comb<BITS, TEETH>::ENTRIES];
+
+// Exponentiations use a left-to-right sliding window of WINDOW bits over a table of 2^(WINDOW - 1)
+// precomputed odd powers (WINDOW = 1 is plain square-and-multiply). The default WINDOW grows with
+// the exponent width; each table entry costs KEY_SIZE bytes of stack.
+// With TEETH > 0, insert_key() raises the fixed base through a Group_Diffie_Hellman_Comb table instead.
+// WINDOW = 0 selects a constant-time Montgomery ladder for every exponentiation (the comb included), so
+// each one takes the same time regardless of the keys, at roughly twice the multiplications of a window.
+template<unsigned int BITS, unsigned int WINDOW = Group_Diffie_Hellman_Common<BITS>::DEFAULT_WINDOW, unsigned int TEETH = 0>
+class Group_Diffie_Hellman: public Group_Diffie_Hellman_Comb<BITS, TEETH>
+{
+private:
+	typedef Group_Diffie_Hellman_Comb<BITS, TEETH> Base;
+
+protected:
+	typedef typename Base::Number Number;
+	typedef typename Base::Digit Digit;
+
+public:
+	typedef typename Base::Round_Key Round_Key;
+	typedef typename Base::Private_Key Private_Key;
+	typedef typename Base::Shared_Key Shared_Key;
+	typedef typename Base::Parameters Parameters;
+
+	// A private key with its inverse and its first round key (base ^ key % q), all of which can be computed ahead of time
+	struct Key_Pair {
+		Private_Key private_key;
+		Private_Key inverse;
+		Round_Key round_key;
+	};
+
+public:
+	Group_Diffie_Hellman(const Parameters & params) : _parameters(params) {
+		Base::montgomery_setup(_r2, _n0, _parameters.q());
+		rotate_key();
+	}
+
+	Group_Diffie_Hellman(const Parameters & params, const Key_Pair & pair) : _parameters(params) {
+		Base::montgomery_setup(_r2, _n0, _parameters.q());
+		rotate_key(pair);
+	}
+
+	Group_Diffie_Hellman() : _parameters(Base::default_parameters()) {
+		Base::montgomery_setup(_r2, _n0, _parameters.q());
+		rotate_key();
+	}
+
+	const Parameters & parameters() const { return _parameters; }
+	const Private_Key & private_key() const { return _private_key; }
+
+	// Draws a new private key (and its inverse) for the same parameters
+	void rotate_key() {
+		Base::generate_private_key(_private_key, _inverted_private_key, _parameters.q());
+		_precomputed = false;
+	}
+
+	// Takes a pair from key_pair() (of an object with the same parameters), so insert_key() costs nothing
+	void rotate_key(const Key_Pair & pair) {
+		_private_key = pair.private_key;
+		_inverted_private_key = pair.inverse;
+		_round_key = pair.round_key;
+		_precomputed = true;
+	}
+
+	// Draws a new Key_Pair without changing the current private key
+	Key_Pair key_pair() const {
+		Key_Pair pair;
+		Base::generate_private_key(pair.private_key, pair.inverse, _parameters.q());
+		pair.round_key = base_exp(pair.private_key);
+		return pair;
+	}
+
+	Round_Key insert_key() const {
+		db<Diffie_Hellman>(TRC) << "Group_Diffie_Hellman::insert_key(round=" << _parameters.base() << ",priv=" << _private_key << ")" << endl;
+
+		if(_precomputed)
+			return _round_key;
+
+		Round_Key round_key = base_exp(_private_key);
+
+		db<Diffie_Hellman>(INF) << "Group_Diffie_Hellman: round key = " << round_key << endl;
+
+		return round_key;
+	}
+
+	Round_Key insert_key(const Round_Key & round_key) const {
+		db<Diffie_Hellman>(TRC) << "Group_Diffie_Hellman::insert_key(round=" << round_key << ",priv=" << _private_key << ")" << endl;
+
+		Round_Key result = mod_exp(round_key, _private_key);
+
+		db<Diffie_Hellman>(INF) << "Group_Diffie_Hellman: round key = " << result << endl;
+
+		return result;
+	}
+
+	// Batch form of insert_key(round_key): round_keys[k] = (round_keys[k] ^ private_key) % q for k < n
+	void insert_key(Round_Key * round_keys, unsigned int n) const {
+		db<Diffie_Hellman>(TRC) << "Group_Diffie_Hellman::insert_key(n=" << n << ",priv=" << _private_key << ")" << endl;
+
+		mod_exp(round_keys, n, _private_key);
+	}
+
+	Round_Key remove_key(const Round_Key & round_key) const {
+		db<Diffie_Hellman>(TRC) << "Group_Diffie_Hellman::remove_key(round=" << round_key << ",priv=" << _private_key << ")" << endl;
+
+		Round_Key result = mod_exp(round_key, _inverted_private_key);
+
+		db<Diffie_Hellman>(INF) << "Group_Diffie_Hellman: round key = " << result << endl;
+
+		return result;
+	}
+
+protected:
+	void montgomery_mult(Number & res, const Number & a, const Number & b) const {
+		Base::montgomery_mult(res, a, b, _parameters.q(), _n0);
+	}
+
+	// R^2 % q, to bring numbers into the Montgomery domain
+	const Number & montgomery_r2() const { return _r2; }
+
+	// (base ^ exponent) % q, for the fixed base of the parameters
+	Number base_exp(const Number & exponent) const {
+		Number y;
+		if(WINDOW && Base::fixed_base_exp(y, _parameters, exponent, _r2, _n0))
+			montgomery_mult(y, y, Number(1));
+		else
+			y = mod_exp(_parameters.base(), exponent);
+		return y;
+	}
+
+	Number mod_exp(const Number & base, const Number & exponent) const {
+		Number y(base);
+		mod_exp(&y, 1, exponent);
+		return y;
+	}
+
+	// values[k] = (values[k] ^ exponent) % q for k < n
+	// The values are raised one at a time, so the stack holds a single window table whatever n is
+	void mod_exp(Number * values, unsigned int n, const Number & exponent) const {
+		if(!WINDOW) {
+			ladder_exp(values, n, exponent);
+			return;
+		}
+
+		for(unsigned int k = 0; k < n; k++)
+			window_exp(values[k], exponent);
 	}
 
-	static Round_Key mod_exp(Round_Key base, Round_Key exponent, const Number& q){
-		int i = 1;
-		Number y = 1;
-		while(exponent > 1){
-			if((exponent % 2) == 1){
-				exponent -= 1;
-				y *= base;
-				y %= q;
+	// value = (value ^ exponent) % q, left-to-right sliding window in the Montgomery domain
+	void window_exp(Number & value, const Number & exponent) const {
+		static const unsigned int ENTRIES = 1 << (WINDOW ? WINDOW - 1 : 0);
+
+		// table[i] = value^(2 * i + 1)
+		Number table[ENTRIES];
+		montgomery_mult(table[0], value, _r2);
+		if(WINDOW > 1) {
+			Number square;
+			montgomery_mult(square, table[0], table[0]);
+			for(unsigned int i = 1; i < ENTRIES; i++)
+				montgomery_mult(table[i], table[i - 1], square);
+		}
+
+		bool one = true; // value is still 1, so squaring it can be skipped
+
+		int i = BITS - 1;
+		while(i >= 0) {
+			if(!Base::bit(exponent, i)) {
+				if(!one)
+					montgomery_mult(value, value, value);
+				i--;
+				continue;
 			}
-			base *= base;
-			base %= q;
-			exponent /= 2;
-			i++;
+
+			// Longest window exponent[i..l] with at most WINDOW bits that ends with a '1'
+			int l = (i + 1 > int(WINDOW)) ? i + 1 - WINDOW : 0;
+			while(!Base::bit(exponent, l))
+				l++;
+
+			unsigned int window = 0;
+			for(int j = i; j >= l; j--)
+				window = (window << 1) | Base::bit(exponent, j);
+
+			if(one)
+				value = table[window >> 1];
+			else {
+				for(int j = i; j >= l; j--)
+					montgomery_mult(value, value, value);
+				montgomery_mult(value, value, table[window >> 1]);
+			}
+			one = false;
+
+			i = l - 1;
 		}
-		return (base * y) % q;
+
+		if(one)
+			value = 1;
+		else
+			montgomery_mult(value, value, Number(1));
 	}
 
-	struct EGCD_Values {
-		Number a;
-		Number b;
-		Number c;
-	};
+	// values[k] = (values[k] ^ exponent) % q for k < n, Montgomery ladder in the Montgomery domain
+	// All BITS bits of the exponent are scanned and each costs one multiplication and one squaring whatever its
+	// value, with r0 and r1 exchanged by masking instead of branching, so the time depends only on BITS and n
+	void ladder_exp(Number * values, unsigned int n, const Number & exponent) const {
+		for(unsigned int k = 0; k < n; k++) {
+			// r1 = r0 * values[k] all along, starting from r0 = 1
+			Number r0, r1;
+			montgomery_mult(r0, Number(1), _r2);
+			montgomery_mult(r1, values[k], _r2);
 
-	static EGCD_Values egcd(Number a, Number b){
-		EGCD_Values result;
+			Digit swapped = 0;
+			for(int i = BITS - 1; i >= 0; i--) {
+				Digit b = Base::bit(exponent, i);
+				Base::conditional_swap(r0, r1, swapped ^ b);
+				swapped = b;
+				montgomery_mult(r1, r0, r1);
+				montgomery_mult(r0, r0, r0);
+			}
+			Base::conditional_swap(r0, r1, swapped);
 
-		if(a == 0){
-			result.a = b;
-			result.b = 0;
-			result.c = 1;
-			return result;
+			montgomery_mult(values[k], r0, Number(1));
 		}
+	}
+
+private:
+	Parameters _parameters;
+	Private_Key _private_key;
+	Private_Key _inverted_private_key;
+	Round_Key _round_key; // base ^ _private_key, if _precomputed
+	bool _precomputed;
+	Number _r2;
+	Digit _n0;
+};
 
-		EGCD_Values inner = egcd(b % a, a);
-		result.a = inner.a;
-		result.b = inner.c - (b / a) * inner.b;
-		result.c = inner.b;
+// Tree-based Group Diffie-Hellman (TGDH): members are the leaves of a binary key tree with up to 2^DEPTH leaves.
+// The secret of an inner node is the blinded key of one child raised to the secret of the other one,
+// k(v) = base^(k(left) * k(right)) % q, and its blinded key is base^k(v). Each member keeps the secrets on the
+// path from its leaf to the root plus the blinded keys of the siblings along that path (the co-path);
+// the root secret is the group key. A change in one leaf therefore costs O(DEPTH) exponentiations and messages.
+// Blocks are the subtrees of a level: block(level) holds this member and sibling(level) is the one it pairs with.
+// A block without leaves (members not a power of two) is skipped and its sibling's secret moves up unchanged.
+template<unsigned int BITS, unsigned int DEPTH, unsigned int WINDOW = Group_Diffie_Hellman_Common<BITS>::DEFAULT_WINDOW, unsigned int TEETH = 0>
+class Tree_Group_Diffie_Hellman: public Group_Diffie_Hellman<BITS, WINDOW, TEETH>
+{
+private:
+	typedef Group_Diffie_Hellman<BITS, WINDOW, TEETH> Base;
+	typedef typename Base::Number Number;
 
-		return result;
+public:
+	typedef typename Base::Round_Key Round_Key;
+	typedef typename Base::Shared_Key Shared_Key;
+	typedef typename Base::Parameters Parameters;
+
+	static const unsigned int MAX_MEMBERS = 1 << DEPTH;
+
+public:
+	// members is clamped to [1, MAX_MEMBERS] and leaf to [0, members), so that no level can index past the tree
+	Tree_Group_Diffie_Hellman(const Parameters & params, unsigned int leaf, unsigned int members) : Base(params) {
+		assert((members >= 1) && (members <= MAX_MEMBERS) && (leaf < members));
+		_members = (members < 1) ? 1 : (members > MAX_MEMBERS) ? MAX_MEMBERS : members;
+		_leaf = (leaf < _members) ? leaf : _members - 1;
+		restart();
+	}
+
+	Tree_Group_Diffie_Hellman() : _leaf(0), _members(1) { restart(); }
+
+	unsigned int leaf() const { return _leaf; }
+	unsigned int members() const { return _members; }
+
+	// Levels of the tree actually spanned by the members
+	unsigned int depth() const {
+		unsigned int d;
+		for(d = 0; (1u << d) < _members; d++);
+		return d;
 	}
 
-	static Number mod_inv(Number a, Number b){
-		EGCD_Values result = egcd(a, b);
+	// Secrets are known up to height(), the group key is known once height() reaches depth()
+	unsigned int height() const { return _height; }
+	bool ready() const { return _height == depth(); }
+
+	unsigned int block(unsigned int level) const { return _leaf >> level; }
+	unsigned int sibling(unsigned int level) const { return block(level) ^ 1; }
+	bool has_sibling(unsigned int level) const { return (sibling(level) << level) < _members; }
+
+	// The lowest leaf of a block announces its blinded key to the sibling block
+	bool sponsor(unsigned int level) const { return !(_leaf & ((1 << level) - 1)); }
+
+	// Blinded key of block(level), with level <= height()
+	Round_Key blinded_key(unsigned int level) const {
+		db<Diffie_Hellman>(TRC) << "Tree_Group_Diffie_Hellman::blinded_key(l=" << level << ")" << endl;
 
-		a = result.a;
-		if(result.b > b){
-			b = (result.b + b) % b;
-		} else {
-			b = result.b % b;
+		return Base::base_exp(_path[level]);
+	}
+
+	// Takes the blinded key of sibling(level) and recomputes the path from there on, as far as the co-path allows
+	// Keys can arrive in any order; a new key for a level that was already known (a rekey) refreshes the levels above it
+	void sibling_key(unsigned int level, const Round_Key & blinded_key) {
+		db<Diffie_Hellman>(TRC) << "Tree_Group_Diffie_Hellman::sibling_key(l=" << level << ",bk=" << blinded_key << ")" << endl;
+
+		_co_path[level] = blinded_key;
+		_known |= 1 << level;
+		if(level <= _height) {
+			_height = level;
+			advance();
 		}
+	}
+
+	const Shared_Key & key() const { return _path[_height]; }
 
-		if(a != 1){
-			// raise exception modular inverse does not exist
-			// shouldnt ever happen if the private key is done correctly
-			return -1;
+	// Draws a new leaf secret; all blinded keys on the path change and must be announced again
+	void rotate_key() {
+		Base::rotate_key();
+		_path[0] = Base::private_key();
+		_height = 0;
+		advance();
+	}
+
+private:
+	void restart() {
+		_path[0] = Base::private_key();
+		_height = 0;
+		_known = 0;
+		advance();
+	}
+
+	void advance() {
+		for(; _height < depth(); _height++) {
+			if(!has_sibling(_height))
+				_path[_height + 1] = _path[_height];
+			else if(_known & (1 << _height))
+				_path[_height + 1] = Base::mod_exp(_co_path[_height], _path[_height]);
+			else
+				break;
 		}
 
-		return b;
+		db<Diffie_Hellman>(INF) << "Tree_Group_Diffie_Hellman: height = " << _height << "/" << depth() << endl;
+	}
+
+private:
+	unsigned int _leaf;
+	unsigned int _members;
+	unsigned int _height;
+	unsigned int _known;
+	Number _path[DEPTH + 1];
+	Round_Key _co_path[DEPTH];
+};
+
+// Burmester-Desmedt Group Diffie-Hellman: a constant-round group key agreement for up to MAX_MEMBERS members
+// arranged in a ring. In the first round each member i broadcasts z(i) = base^r(i); in the second one,
+// X(i) = (z(i + 1) / z(i - 1))^r(i). Each member then computes the key locally, with n - 1 more multiplications:
+// K = z(i - 1)^(n * r(i)) * X(i)^(n - 1) * X(i + 1)^(n - 2) * ... * X(i + n - 2) = base^(r(0) * r(1) + r(1) * r(2) + ... + r(n - 1) * r(0))
+// MAX_MEMBERS must be below 32, since received second-round keys are tracked in a bit mask.
+template<unsigned int BITS, unsigned int MAX_MEMBERS, unsigned int WINDOW = Group_Diffie_Hellman_Common<BITS>::DEFAULT_WINDOW, unsigned int TEETH = 0>
+class Burmester_Desmedt_Group_Diffie_Hellman: public Group_Diffie_Hellman<BITS, WINDOW, TEETH>
+{
+	static_assert(MAX_MEMBERS < 32, "Burmester_Desmedt_Group_Diffie_Hellman tracks members in a 32-bit mask");
+
+private:
+	typedef Group_Diffie_Hellman<BITS, WINDOW, TEETH> Base;
+	typedef typename Base::Number Number;
+
+public:
+	typedef typename Base::Round_Key Round_Key;
+	typedef typename Base::Shared_Key Shared_Key;
+	typedef typename Base::Parameters Parameters;
+
+public:
+	// members is clamped to [1, MAX_MEMBERS] and index to [0, members), so that no round can index past _second
+	Burmester_Desmedt_Group_Diffie_Hellman(const Parameters & params, unsigned int index, unsigned int members) :
+		Base(params), _first_known(0), _second_known(0) {
+		_members = (members < 1) ? 1 : (members > MAX_MEMBERS) ? MAX_MEMBERS : members;
+		_index = (index < _members) ? index : _members - 1;
+	}
+
+	Burmester_Desmedt_Group_Diffie_Hellman() : _index(0), _members(1), _first_known(0), _second_known(0) {}
+
+	unsigned int index() const { return _index; }
+	unsigned int members() const { return _members; }
+	unsigned int previous() const { return (_index + _members - 1) % _members; }
+	unsigned int next() const { return (_index + 1) % _members; }
+
+	// z(index)
+	Round_Key first_round() const { return Base::base_exp(Base::private_key()); }
+
+	// Takes z(member) and tells whether second_round() can already be computed
+	bool first_round(unsigned int member, const Round_Key & round_key) {
+		db<Diffie_Hellman>(TRC) << "Burmester_Desmedt_Group_Diffie_Hellman::first_round(m=" << member << ",z=" << round_key << ")" << endl;
+
+		if(member == previous()) {
+			_previous = round_key;
+			_first_known |= 1;
+		}
+		if(member == next()) {
+			_next = round_key;
+			_first_known |= 2;
+		}
+		return _first_known == 3;
+	}
+
+	// X(index), also recorded as this member's own share of the second round
+	Round_Key second_round() {
+		Number inverse;
+		Base::odd_mod_inv(inverse, _previous, Base::parameters().q());
+		Round_Key round_key = Base::insert_key(mod_mult(_next, inverse));
+
+		second_round(_index, round_key);
+		return round_key;
 	}
 
-	static Number gcd(Number a, Number b){
-		while(b > 0){
-			Number aux = b;
-			b = a % b;
-			a = aux;
+	// Takes X(member) and tells whether the key is ready
+	bool second_round(unsigned int member, const Round_Key & round_key) {
+		db<Diffie_Hellman>(TRC) << "Burmester_Desmedt_Group_Diffie_Hellman::second_round(m=" << member << ",X=" << round_key << ")" << endl;
+
+		if(member < _members) {
+			_second[member] = round_key;
+			_second_known |= 1 << member;
 		}
-		return a;
+		if(ready())
+			compute_key();
+		return ready();
+	}
+
+	bool ready() const { return (_first_known == 3) && (_second_known == (1u << _members) - 1); }
+
+	const Shared_Key & key() const { return _key; }
+
+private:
+	// K = T(0) * T(1) * ... * T(n - 1), with T(0) = z(i - 1)^r(i) and T(j) = T(j - 1) * X(i + j - 1)
+	void compute_key() {
+		Number term, product;
+		to_montgomery(term, Base::insert_key(_previous));
+		product = term;
+		for(unsigned int j = 0; j + 1 < _members; j++) {
+			Number x;
+			to_montgomery(x, _second[(_index + j) % _members]);
+			Base::montgomery_mult(term, term, x);
+			Base::montgomery_mult(product, product, term);
+		}
+		Base::montgomery_mult(_key, product, Number(1));
+	}
+
+	Number mod_mult(const Number & a, const Number & b) const {
+		Number res;
+		to_montgomery(res, a);
+		Base::montgomery_mult(res, res, b);
+		return res;
 	}
+
+	void to_montgomery(Number & res, const Number & a) const {
+		Base::montgomery_mult(res, a, Base::montgomery_r2());
+	}
+
+private:
+	unsigned int _index;
+	unsigned int _members;
+	unsigned int _first_known;
+	unsigned int _second_known;
+	Round_Key _previous;
+	Round_Key _next;
+	Round_Key _second[MAX_MEMBERS];
+	Shared_Key _key;
+};
+
+// Group Diffie-Hellman over the elliptic curve of Elliptic_Curve_Point (secp128r1, whose field is Bignum's modulus).
+// Round keys are affine curve points: insert_key() multiplies them by the private scalar and remove_key() by its
+// inverse modulo the order of the base point, so a 128-bit curve stands in for a multi-kilobit MODP group.
+// The interface mirrors Group_Diffie_Hellman's, so the GDH chain (first, intermediates, last and gateway) is the same.
+class Elliptic_Curve_Group_Diffie_Hellman: private Group_Diffie_Hellman_Common<Cipher::KEY_SIZE * 8>
+{
+private:
+	typedef Group_Diffie_Hellman_Common<Cipher::KEY_SIZE * 8> Base;
+	typedef Base::Number Number;
+
+public:
+	static const unsigned int KEY_SIZE = sizeof(Elliptic_Curve_Point);
+
+	typedef Elliptic_Curve_Point Round_Key;
+	typedef Elliptic_Curve_Point Shared_Key;
+	typedef Number Private_Key;
+	typedef Base::Group_Id Group_Id;
+
+	class Parameters
+	{
+			Elliptic_Curve_Point _base;
+			Number _order;
+		public:
+			Parameters(const Parameters& params) : _base(params.base()), _order(params.order()) {}
+			Parameters(const Elliptic_Curve_Point& base, const Number& order) : _base(base), _order(order) {}
+
+			const Elliptic_Curve_Point & base() const { return _base; }
+			const Number & order() const { return _order; }
+
+			friend OStream & operator<<(OStream & db, const Parameters & m) {
+				db << "(Parameters base=" << m._base << ", order=" << m._order << ")";
+				return db;
+			}
+			friend Debug & operator<<(Debug & db, const Parameters & m) {
+				db << "(Parameters base=" << m._base << ", order=" << m._order << ")";
+				return db;
+			}
+	};
+
+	// A private scalar with its inverse and its first round key (base * scalar)
+	struct Key_Pair {
+		Private_Key private_key;
+		Private_Key inverse;
+		Round_Key round_key;
+	};
+
+public:
+	Elliptic_Curve_Group_Diffie_Hellman(const Parameters & params) : _parameters(params) { rotate_key(); }
+	Elliptic_Curve_Group_Diffie_Hellman(const Parameters & params, const Key_Pair & pair) : _parameters(params) { rotate_key(pair); }
+	Elliptic_Curve_Group_Diffie_Hellman() : _parameters(default_parameters()) { rotate_key(); }
+
+	static Parameters default_parameters() {
+		Elliptic_Curve_Point base;
+		base.x = Number(_default_base_x, sizeof(Number));
+		base.y = Number(_default_base_y, sizeof(Number));
+		base.z = 1;
+		return Parameters(base, Number(_default_order, sizeof(Number)));
+	}
+
+	const Parameters & parameters() const { return _parameters; }
+	const Private_Key & private_key() const { return _private_key; }
+
+	void rotate_key() {
+		generate_private_key(_private_key, _inverted_private_key, _parameters.order());
+		_precomputed = false;
+	}
+
+	void rotate_key(const Key_Pair & pair) {
+		_private_key = pair.private_key;
+		_inverted_private_key = pair.inverse;
+		_round_key = pair.round_key;
+		_precomputed = true;
+	}
+
+	Key_Pair key_pair() const {
+		Key_Pair pair;
+		generate_private_key(pair.private_key, pair.inverse, _parameters.order());
+		pair.round_key = multiply(_parameters.base(), pair.private_key);
+		return pair;
+	}
+
+	Round_Key insert_key() const {
+		db<Diffie_Hellman>(TRC) << "Elliptic_Curve_Group_Diffie_Hellman::insert_key(round=" << _parameters.base() << ",priv=" << _private_key << ")" << endl;
+
+		return _precomputed ? _round_key : multiply(_parameters.base(), _private_key);
+	}
+
+	Round_Key insert_key(const Round_Key & round_key) const {
+		db<Diffie_Hellman>(TRC) << "Elliptic_Curve_Group_Diffie_Hellman::insert_key(round=" << round_key << ",priv=" << _private_key << ")" << endl;
+
+		return multiply(round_key, _private_key);
+	}
+
+	void insert_key(Round_Key * round_keys, unsigned int n) const {
+		for(unsigned int k = 0; k < n; k++)
+			round_keys[k] = multiply(round_keys[k], _private_key);
+	}
+
+	Round_Key remove_key(const Round_Key & round_key) const {
+		db<Diffie_Hellman>(TRC) << "Elliptic_Curve_Group_Diffie_Hellman::remove_key(round=" << round_key << ",priv=" << _private_key << ")" << endl;
+
+		return multiply(round_key, _inverted_private_key);
+	}
+
+private:
+	// Random scalar in [1, order - 1] and its inverse modulo order (a prime, so the inverse always exists)
+	static void generate_private_key(Private_Key & key, Private_Key & inverse, const Number & order) {
+		unsigned char bytes[sizeof(Number)];
+		do {
+			for(unsigned int i = 0; i < sizeof(Number); i++)
+				bytes[i] = Random::random();
+			key = Number(bytes, sizeof(Number));
+		} while((key == Number(0)) || (key >= order));
+		Base::odd_mod_inv(inverse, key, order);
+	}
+
+	static Round_Key multiply(const Round_Key & point, const Private_Key & scalar) {
+		Round_Key res(point);
+		res *= scalar;
+		return res;
+	}
+
+private:
+	Parameters _parameters;
+	Private_Key _private_key;
+	Private_Key _inverted_private_key;
+	Round_Key _round_key; // base * _private_key, if _precomputed
+	bool _precomputed;
+
+	static const unsigned char _default_base_x[sizeof(Number)];
+	static const unsigned char _default_base_y[sizeof(Number)];
+	static const unsigned char _default_order[sizeof(Number)];
 };
 
 __END_SYS
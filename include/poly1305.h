@@ -39,7 +39,7 @@ public:
         cipher.encrypt(nonce, reinterpret_cast<const unsigned char *>(_k._data), ciphertext);
 
         // out = (cr + aes(k,n)) % 2^128
-        Bignum::simple_add(reinterpret_cast<Bignum::Digit *>(out), reinterpret_cast<const Bignum::Digit *>(ciphertext), cr._data, 4);
+        Bignum::simple_add(reinterpret_cast<Bignum::Digit *>(out), reinterpret_cast<const Bignum::Digit *>(ciphertext), cr._data, 16 / sizeof(Bignum::Digit));
     }
 
     bool verify(const unsigned char mac[16], const unsigned char nonce[16], const unsigned char * message, unsigned int message_len) {
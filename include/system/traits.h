@@ -58,6 +58,15 @@ template<> struct Traits<Heaps>: public Traits<void>
     static const bool debugged = hysterically_debugged;
 };
 
+template<> struct Traits<Bignums>: public Traits<void>
+{
+    // Bytes per Bignum digit: 4 or 8 (8 needs a compiler with a 128-bit integer type, e.g. on x86-64 hosts)
+    static const unsigned int DIGIT_SIZE = 4;
+
+    // Fully unroll the kernels of Bignums of up to 16 digits (faster, but costs flash; false shares loops among all sizes)
+    static const bool UNROLLED = true;
+};
+
 
 // System Parts (mostly to fine control debugging)
 template<> struct Traits<Boot>: public Traits<void>
@@ -90,6 +99,17 @@ template<> template <unsigned int S> struct Traits<Software_AES<S>>: public Trai
     static const unsigned int KEY_SIZE = 16;
 };
 
+template<> struct Traits<Group_Diffie_Hellman_Parameters>: public Traits<void>
+{
+    // Group used by TSTP's GDH_Security: 32 (toy), 128, 256, 1024, 1536, 2048 or 3072 bits
+    // TSTP round keys must fit in a frame, so only groups up to 128 bits work over the radio
+    static const unsigned int BITS = 32;
+
+    // Constant-time exponentiations (Montgomery ladder): the same cost for any key, so rekeying fits a fixed
+    // TSTP MAC slot without jitter, at about twice the time of the default sliding window
+    static const bool CONSTANT_TIME = false;
+};
+
 __END_SYS
 
 #include __ARCH_TRAITS_H
@@ -51,6 +51,7 @@ enum Power_Mode
 __BEGIN_UTIL
 typedef unsigned char Percent;
 class Dummy {};
+class Bignums;
 class Bitmaps;
 class CRC;
 class ELF;
@@ -164,6 +165,16 @@ class Alarm;
 class Delay;
 
 class Diffie_Hellman;
+template<unsigned int BITS>
+class Group_Diffie_Hellman_Common;
+template<unsigned int BITS, unsigned int WINDOW, unsigned int TEETH>
+class Group_Diffie_Hellman;
+template<unsigned int BITS, unsigned int DEPTH, unsigned int WINDOW, unsigned int TEETH>
+class Tree_Group_Diffie_Hellman;
+template<unsigned int BITS, unsigned int MAX_MEMBERS, unsigned int WINDOW, unsigned int TEETH>
+class Burmester_Desmedt_Group_Diffie_Hellman;
+class Elliptic_Curve_Group_Diffie_Hellman;
+class Group_Diffie_Hellman_Parameters;
 class Poly1305;
 
 class Network;
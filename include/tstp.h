@@ -61,6 +61,16 @@ public:
 		GDH_ROUND = 11,
 		GDH_BROADCAST = 12,
 		GDH_RESPONSE = 13,
+		GDH_BATCH_BROADCAST = 14,
+		TGDH_SETUP = 15,
+		TGDH_BLINDED = 16,
+		BD_SETUP = 17,
+		BD_FIRST_ROUND = 18,
+		BD_SECOND_ROUND = 19,
+		GDH_JOIN = 20,
+		GDH_REKEY = 21,
+		GDH_MULTI_BROADCAST = 22,
+		GDH_CHAIN_SETUP = 23,
     };
 
 	enum GDH_State {
@@ -69,12 +79,17 @@ public:
 		GDH_WAITING_POP = 2,
 		GDH_WAITING_FINAL = 3,
 		GDH_WAITING_GW = 4,
+		GDH_READY = 5,
+		GDH_FAILED = 6,
+		GDH_ENDED = 7, // end_group() was called; the Crypto_Worker deletes the context
 	};
 
 	enum GDH_Node_Type {
 		GDH_FIRST = 0,
 		GDH_INTERMEDIATE = 1,
 		GDH_LAST = 2,
+		GDH_TREE = 3,
+		GDH_BURMESTER_DESMEDT = 4,
 	};
 
     // Scale for local network's geographic coordinates
@@ -517,6 +532,7 @@ __END_SYS
 #include <group_diffie_hellman.h>
 #include <cipher.h>
 #include <thread.h>
+#include <mutex.h>
 #include <alarm.h>
 #include <poly1305.h>
 
@@ -847,9 +863,45 @@ public:
     // } __attribute__((packed)); // TODO
     };
 
+	// Round keys and parameters travel inside a single TSTP frame, which bounds the group size (see Traits)
+	// First-round keys (GDH_Setup_First and the gateway) are raised through a GDH_TEETH fixed-base comb,
+	// unless exponentiations must be constant-time, in which case every one goes through a Montgomery ladder
+	static const unsigned int GDH_BITS = Traits<Group_Diffie_Hellman_Parameters>::BITS;
+	static const unsigned int GDH_WINDOW = Traits<Group_Diffie_Hellman_Parameters>::CONSTANT_TIME ? 0 : _SYS::Group_Diffie_Hellman_Common<GDH_BITS>::DEFAULT_WINDOW;
+	static const unsigned int GDH_TEETH = Traits<Group_Diffie_Hellman_Parameters>::CONSTANT_TIME ? 0 : 4;
+	typedef _SYS::Group_Diffie_Hellman<GDH_BITS, GDH_WINDOW, GDH_TEETH> GDH;
+
+	// Members of a chain GDH group, kept by the gateway so that nodes can join (and leave) it later
+	static const unsigned int GDH_MAX_MEMBERS = 16;
+
+	// Tree-based GDH (TGDH) mode: members are the leaves of a binary key tree with up to 2^TGDH_DEPTH leaves
+	static const unsigned int TGDH_DEPTH = 5;
+	typedef _SYS::Tree_Group_Diffie_Hellman<GDH_BITS, TGDH_DEPTH, GDH_WINDOW, GDH_TEETH> TGDH;
+
+	// Burmester-Desmedt (BD) mode: two rounds in which every member broadcasts once, regardless of the group size
+	static const unsigned int BD_MAX_MEMBERS = 16;
+	typedef _SYS::Burmester_Desmedt_Group_Diffie_Hellman<GDH_BITS, BD_MAX_MEMBERS, GDH_WINDOW, GDH_TEETH> BD;
+
+	// In batch mode the gateway collects GDH_Responses and answers them with GDH_Batch_Broadcasts
+	// (one exponentiation pass and one frame per GDH_Batch_Broadcast::ENTRIES members)
+	static const bool GDH_BATCH = true;
+
+	// Groups a node can take part in at once (each one has its own GDH_Security context)
+	static const unsigned int GDH_MAX_GROUPS = 4;
+
+	// GDH frames must be delivered within GDH_TIMEOUT, which is also how long a member waits in each state before
+	// retransmitting the last message it sent. After GDH_RETRIES retransmissions the group is GDH_FAILED
+	static const unsigned int GDH_TIMEOUT = 3 * 1000 * 1000; // us
+	static const unsigned int GDH_RETRIES = 3;
+
+	// Private keys (with their first round keys) drawn ahead of time by the Crypto_Worker, for the parameters of the
+	// last group set up (initially the default ones). Pooled keys older than GDH_KEY_POOL_LIFETIME are never handed out
+	static const unsigned int GDH_KEY_POOL = 2;
+	static const unsigned long long GDH_KEY_POOL_LIFETIME = 60 * 60 * 1000000ull; // us
+
 	typedef int Group_Id;
-	typedef Group_Diffie_Hellman::Parameters Parameters;
-	typedef Group_Diffie_Hellman::Round_Key Round_Key;
+	typedef GDH::Parameters Parameters;
+	typedef GDH::Round_Key Round_Key;
 
 	// Group Diffie-Hellman setup first node Security Bootstrap Control Message
     class GDH_Setup_First: public Control
@@ -1078,6 +1130,507 @@ public:
     //} __attribute__((packed)); // TODO
     };
 
+	// Sphere enclosing a set of spaces, used to address several GDH members with a single frame
+	static Region::Space gdh_enclosing_space(const Region::Space * spaces, unsigned int n) {
+		long long min[3] = { spaces[0].center.x, spaces[0].center.y, spaces[0].center.z };
+		long long max[3] = { spaces[0].center.x, spaces[0].center.y, spaces[0].center.z };
+		for(unsigned int i = 1; i < n; i++) {
+			long long c[3] = { spaces[i].center.x, spaces[i].center.y, spaces[i].center.z };
+			for(unsigned int j = 0; j < 3; j++) {
+				if(c[j] < min[j])
+					min[j] = c[j];
+				if(c[j] > max[j])
+					max[j] = c[j];
+			}
+		}
+
+		Region::Space enclosing(Region::Center((min[0] + max[0]) / 2, (min[1] + max[1]) / 2, (min[2] + max[2]) / 2), 0);
+		for(unsigned int i = 0; i < n; i++) {
+			Region::Space::Radius r = (enclosing.center - spaces[i].center) + spaces[i].radius + 1; // + 1 makes up for the rounded center
+			if(r > enclosing.radius)
+				enclosing.radius = r;
+		}
+		return enclosing;
+	}
+
+	// Group Diffie-Hellman Batch Broadcast Security Bootstrap Control Message
+	// Carries the round keys for several members; its destination is a sphere enclosing all of them
+    class GDH_Batch_Broadcast: public Control
+    {
+    public:
+		// As many members as fit in a frame, keeping room for the worst-case alignment padding (messages aren't packed)
+		static const unsigned int ENTRIES = (MTU - (sizeof(Control) - sizeof(Header)) - sizeof(Group_Id) - sizeof(unsigned char) - sizeof(Region::Space) - sizeof(CRC) - 3 * (sizeof(int) - 1))
+		                                    / (sizeof(Region::Space) + sizeof(Round_Key));
+
+    public:
+		GDH_Batch_Broadcast(const Group_Id & group_id, const Region::Space * members, const Round_Key * round_keys, unsigned int count)
+        : Control(GDH_BATCH_BROADCAST, 0, 0, now(), here(), here()), _group_id(group_id), _count(count), _destination(gdh_enclosing_space(members, count)) {
+			for(unsigned int i = 0; i < _count; i++) {
+				_members[i] = members[i];
+				_round_keys[i] = round_keys[i];
+			}
+		}
+
+		const Group_Id group_id() { return _group_id; }
+
+		const Region::Space & destination() { return _destination; }
+
+		unsigned int count() { return _count; }
+
+		// Round key addressed to the member at c, or 0 if c is not in this batch
+		const Round_Key * round_key(const Coordinates & c) {
+			for(unsigned int i = 0; i < _count; i++)
+				if(_members[i].contains(c))
+					return &_round_keys[i];
+			return 0;
+		}
+
+        friend Debug & operator<<(Debug & db, const GDH_Batch_Broadcast & m) {
+            db << reinterpret_cast<const Control &>(m) << "g=" << m._group_id << ",n=" << m._count;
+            return db;
+        }
+        friend OStream & operator<<(OStream & db, const GDH_Batch_Broadcast & m) {
+            db << reinterpret_cast<const Control &>(m) << "g=" << m._group_id << ",n=" << m._count;
+            return db;
+        }
+
+    private:
+		Group_Id _group_id;
+		unsigned char _count;
+		Region::Space _destination;
+		Region::Space _members[ENTRIES];
+		Round_Key _round_keys[ENTRIES];
+        CRC _crc;
+    //} __attribute__((packed)); // TODO
+    };
+
+	// Group Diffie-Hellman Multi-destination Broadcast Security Bootstrap Control Message
+	// A single round key for several members: routed to the space enclosing them and accepted by any listed member
+    class GDH_Multi_Broadcast: public Control
+    {
+    public:
+		// As many members as fit in a frame, keeping room for the worst-case alignment padding (messages aren't packed)
+		static const unsigned int ENTRIES = (MTU - (sizeof(Control) - sizeof(Header)) - sizeof(Group_Id) - sizeof(unsigned char) - sizeof(Region::Space) - sizeof(Round_Key) - sizeof(CRC) - 3 * (sizeof(int) - 1))
+		                                    / sizeof(Region::Space);
+
+    public:
+		GDH_Multi_Broadcast(const Group_Id & group_id, const Region::Space * members, unsigned int count, const Round_Key & round_key)
+        : Control(GDH_MULTI_BROADCAST, 0, 0, now(), here(), here()), _group_id(group_id), _count(count), _destination(gdh_enclosing_space(members, count)), _round_key(round_key) {
+			for(unsigned int i = 0; i < _count; i++)
+				_members[i] = members[i];
+		}
+
+		const Group_Id group_id() { return _group_id; }
+
+		const Region::Space & destination() { return _destination; }
+
+		unsigned int count() { return _count; }
+
+		const Round_Key & round_key() { return _round_key; }
+
+		bool addressed_to(const Coordinates & c) {
+			for(unsigned int i = 0; i < _count; i++)
+				if(_members[i].contains(c))
+					return true;
+			return false;
+		}
+
+        friend Debug & operator<<(Debug & db, const GDH_Multi_Broadcast & m) {
+            db << reinterpret_cast<const Control &>(m) << "g=" << m._group_id << ",n=" << m._count << ",k=" << m._round_key;
+            return db;
+        }
+        friend OStream & operator<<(OStream & db, const GDH_Multi_Broadcast & m) {
+            db << reinterpret_cast<const Control &>(m) << "g=" << m._group_id << ",n=" << m._count << ",k=" << m._round_key;
+            return db;
+        }
+
+    private:
+		Group_Id _group_id;
+		unsigned char _count;
+		Region::Space _destination;
+		Round_Key _round_key;
+		Region::Space _members[ENTRIES];
+        CRC _crc;
+    //} __attribute__((packed)); // TODO
+    };
+
+	// Group Diffie-Hellman Chain Setup Security Bootstrap Control Message
+	// Describes a whole chain (first, intermediates, last) so that all members can be set up by a handful of frames.
+	// Members are delta-encoded from the sink (zig-zag varints). Long chains are split into fragments that overlap
+	// by one member, so everyone finds its next in the fragment that lists it. Every fragment also reaches the last member
+    class GDH_Chain_Setup: public Control
+    {
+    public:
+		static const unsigned int DATA_SIZE = MTU - (sizeof(Control) - sizeof(Header)) - sizeof(Group_Id) - 2 * sizeof(Region::Space) - 4 * sizeof(unsigned char) - sizeof(Parameters) - sizeof(CRC) - 3 * (sizeof(int) - 1);
+		static const unsigned int MAX_ENTRIES = DATA_SIZE / 4; // each coordinate and the radius take at least one byte
+
+    public:
+		// Encodes as many members as fit, starting at chain[first]
+		GDH_Chain_Setup(const Group_Id & group_id, const Parameters & parameters, const Region::Space * chain, unsigned int first, unsigned int members)
+        : Control(GDH_CHAIN_SETUP, 0, 0, now(), here(), here()), _group_id(group_id), _last(chain[members - 1]), _first(first), _count(0), _members(members), _size(0), _parameters(parameters) {
+			Region::Center reference = sink();
+			for(unsigned int i = first; (i < members) && (_count < MAX_ENTRIES); i++) {
+				unsigned char entry[4 * 10];
+				unsigned int size = encode(entry, chain[i], reference);
+				if(_size + size > DATA_SIZE)
+					break;
+				memcpy(&_data[_size], entry, size);
+				_size += size;
+				_count++;
+				reference = chain[i].center;
+			}
+
+			Region::Space covered[MAX_ENTRIES + 1];
+			for(unsigned int i = 0; i < _count; i++)
+				covered[i] = chain[first + i];
+			covered[_count] = _last;
+			_destination = gdh_enclosing_space(covered, _count + 1);
+		}
+
+		const Group_Id group_id() { return _group_id; }
+
+		const Region::Space & destination() { return _destination; }
+
+		const Region::Space & last() { return _last; }
+
+		const Parameters & parameters() { return _parameters; }
+
+		// Index in the chain of the first member listed
+		unsigned int first() { return _first; }
+
+		// Members listed (the last one is repeated by the next fragment, unless it ends the chain)
+		unsigned int count() { return _count; }
+
+		// Members set up by this fragment
+		unsigned int owned() { return (_first + _count < _members) ? _count - 1 : _count; }
+
+		unsigned int members() { return _members; }
+
+		// Fills spaces[0 .. count()) and returns false if the listing is malformed (spaces must hold MAX_ENTRIES)
+		bool decode(Region::Space * spaces) {
+			if((_count < 1) || (_count > MAX_ENTRIES) || (_size > DATA_SIZE))
+				return false;
+			Region::Center reference = sink();
+			unsigned int pos = 0;
+			for(unsigned int i = 0; i < _count; i++) {
+				long long c[3];
+				for(unsigned int j = 0; j < 3; j++) {
+					unsigned int size = get(&_data[pos], _size - pos, &c[j]);
+					if(!size)
+						return false;
+					pos += size;
+				}
+				unsigned long long radius;
+				unsigned int size = get(&_data[pos], _size - pos, &radius);
+				if(!size)
+					return false;
+				pos += size;
+				spaces[i] = Region::Space(Region::Center(reference.x + c[0], reference.y + c[1], reference.z + c[2]), radius);
+				reference = spaces[i].center;
+			}
+			return pos == _size;
+		}
+
+        friend Debug & operator<<(Debug & db, const GDH_Chain_Setup & m) {
+            db << reinterpret_cast<const Control &>(m) << ",p=" << m._parameters << ",g=" << m._group_id << ",f=" << m._first << ",n=" << m._count << "/" << m._members << ",s=" << m._size;
+            return db;
+        }
+        friend OStream & operator<<(OStream & db, const GDH_Chain_Setup & m) {
+            db << reinterpret_cast<const Control &>(m) << ",p=" << m._parameters << ",g=" << m._group_id << ",f=" << m._first << ",n=" << m._count << "/" << m._members << ",s=" << m._size;
+            return db;
+        }
+
+    private:
+		static unsigned int encode(unsigned char * out, const Region::Space & space, const Region::Center & reference) {
+			unsigned int size = put(out, static_cast<long long>(space.center.x) - reference.x);
+			size += put(&out[size], static_cast<long long>(space.center.y) - reference.y);
+			size += put(&out[size], static_cast<long long>(space.center.z) - reference.z);
+			size += put(&out[size], static_cast<unsigned long long>(space.radius));
+			return size;
+		}
+
+		// Zig-zag varints: 7 bits per byte, least significant group first
+		static unsigned int put(unsigned char * out, long long value) {
+			return put(out, (static_cast<unsigned long long>(value) << 1) ^ static_cast<unsigned long long>(value >> 63));
+		}
+		static unsigned int put(unsigned char * out, unsigned long long value) {
+			unsigned int size = 0;
+			do {
+				out[size] = value & 0x7f;
+				value >>= 7;
+				if(value)
+					out[size] |= 0x80;
+				size++;
+			} while(value);
+			return size;
+		}
+		// Reads at most available bytes (and never more than a 64-bit varint takes), returning 0 on a truncated varint
+		static unsigned int get(const unsigned char * in, unsigned int available, unsigned long long * value) {
+			unsigned int size = 0;
+			*value = 0;
+			do {
+				if((size == available) || (size == 10))
+					return 0;
+				*value |= static_cast<unsigned long long>(in[size] & 0x7f) << (7 * size);
+			} while(in[size++] & 0x80);
+			return size;
+		}
+		static unsigned int get(const unsigned char * in, unsigned int available, long long * value) {
+			unsigned long long zigzag;
+			unsigned int size = get(in, available, &zigzag);
+			*value = static_cast<long long>(zigzag >> 1) ^ -static_cast<long long>(zigzag & 1);
+			return size;
+		}
+
+    private:
+		Group_Id _group_id;
+		Region::Space _destination;
+		Region::Space _last;
+		unsigned char _first;
+		unsigned char _count;
+		unsigned char _members;
+		unsigned char _size;
+		Parameters _parameters;
+		unsigned char _data[DATA_SIZE];
+        CRC _crc;
+    //} __attribute__((packed)); // TODO
+    };
+
+	// Group Diffie-Hellman Join Security Bootstrap Control Message
+	// Asks the last member of the chain to re-randomize its share and hand the chain on to the joining node
+    class GDH_Join: public Control
+    {
+    public:
+		GDH_Join(const Group_Id & group_id, const Region::Space & destination, const Region::Space & joining)
+        : Control(GDH_JOIN, 0, 0, now(), here(), here()), _destination(destination), _joining(joining), _group_id(group_id) { }
+
+		const Group_Id group_id() { return _group_id; }
+
+		const Region::Space & destination() { return _destination; }
+
+		const Region::Space & joining() { return _joining; }
+
+        friend Debug & operator<<(Debug & db, const GDH_Join & m) {
+            db << reinterpret_cast<const Control &>(m) << ",j=" << m._joining << ",g=" << m._group_id;
+            return db;
+        }
+        friend OStream & operator<<(OStream & db, const GDH_Join & m) {
+            db << reinterpret_cast<const Control &>(m) << ",j=" << m._joining << ",g=" << m._group_id;
+            return db;
+        }
+
+    private:
+		Region::Space _destination;
+		Region::Space _joining;
+		Group_Id _group_id;
+        CRC _crc;
+    //} __attribute__((packed)); // TODO
+    };
+
+	// Group Diffie-Hellman Rekey Security Bootstrap Control Message
+	// Hands the new group key to the holders of the previous one, masked by a one-way function of the latter
+	// Nodes within the excluded space (e.g. the one that just joined) do not hold the previous key and ignore it
+    class GDH_Rekey: public Control
+    {
+    public:
+		GDH_Rekey(const Group_Id & group_id, const Region::Space & destination, const Region::Space & excluded, const Round_Key & masked_key)
+        : Control(GDH_REKEY, 0, 0, now(), here(), here()), _destination(destination), _excluded(excluded), _group_id(group_id), _masked_key(masked_key) { }
+
+		const Group_Id group_id() { return _group_id; }
+
+		const Region::Space & destination() { return _destination; }
+
+		const Region::Space & excluded() { return _excluded; }
+
+		Round_Key masked_key() { return _masked_key; }
+
+        friend Debug & operator<<(Debug & db, const GDH_Rekey & m) {
+            db << reinterpret_cast<const Control &>(m) << ",x=" << m._excluded << ",g=" << m._group_id;
+            return db;
+        }
+        friend OStream & operator<<(OStream & db, const GDH_Rekey & m) {
+            db << reinterpret_cast<const Control &>(m) << ",x=" << m._excluded << ",g=" << m._group_id;
+            return db;
+        }
+
+    private:
+		Region::Space _destination;
+		Region::Space _excluded;
+		Group_Id _group_id;
+		Round_Key _masked_key;
+        CRC _crc;
+    //} __attribute__((packed)); // TODO
+    };
+
+	// Tree Group Diffie-Hellman Setup Security Bootstrap Control Message
+	// Assigns a leaf of the key tree and tells, for each level, where the members of the sibling block are
+    class TGDH_Setup: public Control
+    {
+    public:
+		TGDH_Setup(const Group_Id & group_id, const Region::Space & destination, const Parameters & parameters, unsigned int leaf, unsigned int members, const Region::Space * siblings)
+        : Control(TGDH_SETUP, 0, 0, now(), here(), here()), _destination(destination), _parameters(parameters), _group_id(group_id), _leaf(leaf), _members(members) {
+			for(unsigned int i = 0; i < TGDH_DEPTH; i++)
+				_siblings[i] = siblings[i];
+		}
+
+		const Group_Id group_id() { return _group_id; }
+
+		const Region::Space & destination() { return _destination; }
+
+        const Parameters & parameters() { return _parameters; }
+
+		unsigned int leaf() { return _leaf; }
+		unsigned int members() { return _members; }
+		const Region::Space & sibling(unsigned int level) { return _siblings[level]; }
+
+        friend Debug & operator<<(Debug & db, const TGDH_Setup & m) {
+            db << reinterpret_cast<const Control &>(m) << ",p=" << m._parameters << ",g=" << m._group_id << ",l=" << m._leaf << ",m=" << m._members;
+            return db;
+        }
+        friend OStream & operator<<(OStream & db, const TGDH_Setup & m) {
+            db << reinterpret_cast<const Control &>(m) << ",p=" << m._parameters << ",g=" << m._group_id << ",l=" << m._leaf << ",m=" << m._members;
+            return db;
+        }
+
+    private:
+		Region::Space _destination;
+        Parameters _parameters;
+		Group_Id _group_id;
+		unsigned char _leaf;
+		unsigned char _members;
+		Region::Space _siblings[TGDH_DEPTH];
+        CRC _crc;
+    //} __attribute__((packed)); // TODO
+    };
+
+	// Tree Group Diffie-Hellman Blinded Key Security Bootstrap Control Message
+	// Carries the blinded key of a block of the key tree to the members of its sibling block
+    class TGDH_Blinded: public Control
+    {
+    public:
+		TGDH_Blinded(const Group_Id & group_id, const Region::Space & destination, unsigned int level, unsigned int block, const Round_Key & blinded_key)
+        : Control(TGDH_BLINDED, 0, 0, now(), here(), here()), _destination(destination), _group_id(group_id), _level(level), _block(block), _blinded_key(blinded_key) { }
+
+		const Group_Id group_id() { return _group_id; }
+
+		const Region::Space & destination() { return _destination; }
+
+		unsigned int level() { return _level; }
+		unsigned int block() { return _block; }
+		Round_Key blinded_key() { return _blinded_key; }
+
+        friend Debug & operator<<(Debug & db, const TGDH_Blinded & m) {
+            db << reinterpret_cast<const Control &>(m) << "g=" << m._group_id << ",l=" << m._level << ",b=" << m._block << ",bk=" << m._blinded_key;
+            return db;
+        }
+        friend OStream & operator<<(OStream & db, const TGDH_Blinded & m) {
+            db << reinterpret_cast<const Control &>(m) << "g=" << m._group_id << ",l=" << m._level << ",b=" << m._block << ",bk=" << m._blinded_key;
+            return db;
+        }
+
+    private:
+		Region::Space _destination;
+		Group_Id _group_id;
+		unsigned char _level;
+		unsigned char _block;
+		Round_Key _blinded_key;
+        CRC _crc;
+    //} __attribute__((packed)); // TODO
+    };
+
+	// Burmester-Desmedt Setup Security Bootstrap Control Message
+	// Assigns a position in the ring and gives the space enclosing the whole group, to which both rounds are broadcast
+    class BD_Setup: public Control
+    {
+    public:
+		BD_Setup(const Group_Id & group_id, const Region::Space & destination, const Parameters & parameters, unsigned int index, unsigned int members, const Region::Space & group)
+        : Control(BD_SETUP, 0, 0, now(), here(), here()), _destination(destination), _group(group), _parameters(parameters), _group_id(group_id), _index(index), _members(members) { }
+
+		const Group_Id group_id() { return _group_id; }
+
+		const Region::Space & destination() { return _destination; }
+
+		const Region::Space & group() { return _group; }
+
+        const Parameters & parameters() { return _parameters; }
+
+		unsigned int index() { return _index; }
+		unsigned int members() { return _members; }
+
+        friend Debug & operator<<(Debug & db, const BD_Setup & m) {
+            db << reinterpret_cast<const Control &>(m) << ",p=" << m._parameters << ",g=" << m._group_id << ",i=" << m._index << ",m=" << m._members;
+            return db;
+        }
+        friend OStream & operator<<(OStream & db, const BD_Setup & m) {
+            db << reinterpret_cast<const Control &>(m) << ",p=" << m._parameters << ",g=" << m._group_id << ",i=" << m._index << ",m=" << m._members;
+            return db;
+        }
+
+    private:
+		Region::Space _destination;
+		Region::Space _group;
+        Parameters _parameters;
+		Group_Id _group_id;
+		unsigned char _index;
+		unsigned char _members;
+        CRC _crc;
+    //} __attribute__((packed)); // TODO
+    };
+
+	// Burmester-Desmedt Round Security Bootstrap Control Message (BD_FIRST_ROUND carries z(i), BD_SECOND_ROUND carries X(i))
+    class BD_Round: public Control
+    {
+    public:
+		BD_Round(const Subtype & subtype, const Group_Id & group_id, const Region::Space & destination, unsigned int index, const Round_Key & round_key)
+        : Control(subtype, 0, 0, now(), here(), here()), _destination(destination), _group_id(group_id), _index(index), _round_key(round_key) { }
+
+		const Group_Id group_id() { return _group_id; }
+
+		const Region::Space & destination() { return _destination; }
+
+		unsigned int index() { return _index; }
+
+		Round_Key round_key() { return _round_key; }
+
+        friend Debug & operator<<(Debug & db, const BD_Round & m) {
+            db << reinterpret_cast<const Control &>(m) << "g=" << m._group_id << ",i=" << m._index << ",r=" << m._round_key;
+            return db;
+        }
+        friend OStream & operator<<(OStream & db, const BD_Round & m) {
+            db << reinterpret_cast<const Control &>(m) << "g=" << m._group_id << ",i=" << m._index << ",r=" << m._round_key;
+            return db;
+        }
+
+    private:
+		Region::Space _destination;
+		Group_Id _group_id;
+		unsigned char _index;
+		Round_Key _round_key;
+        CRC _crc;
+    //} __attribute__((packed)); // TODO
+    };
+
+	// Every GDH message must fit in a single frame for the group chosen in Traits<Group_Diffie_Hellman_Parameters>
+	static_assert(sizeof(GDH_Setup_First) - sizeof(Header) <= MTU, "GDH_Setup_First does not fit in a frame");
+	static_assert(sizeof(GDH_Setup_Intermediate) - sizeof(Header) <= MTU, "GDH_Setup_Intermediate does not fit in a frame");
+	static_assert(sizeof(GDH_Setup_Last) - sizeof(Header) <= MTU, "GDH_Setup_Last does not fit in a frame");
+	static_assert(sizeof(GDH_Setup_Last_Follow) - sizeof(Header) <= MTU, "GDH_Setup_Last_Follow does not fit in a frame");
+	static_assert(sizeof(GDH_Round) - sizeof(Header) <= MTU, "GDH_Round does not fit in a frame (Round_Key too large)");
+	static_assert(sizeof(GDH_Broadcast) - sizeof(Header) <= MTU, "GDH_Broadcast does not fit in a frame (Round_Key too large)");
+	static_assert(sizeof(GDH_Response) - sizeof(Header) <= MTU, "GDH_Response does not fit in a frame (Round_Key too large)");
+	static_assert(GDH_Batch_Broadcast::ENTRIES >= 1, "GDH_Batch_Broadcast cannot carry a single member");
+	static_assert(sizeof(GDH_Batch_Broadcast) - sizeof(Header) <= MTU, "GDH_Batch_Broadcast does not fit in a frame");
+	static_assert(GDH_Multi_Broadcast::ENTRIES >= 1, "GDH_Multi_Broadcast cannot carry a single member");
+	static_assert(sizeof(GDH_Multi_Broadcast) - sizeof(Header) <= MTU, "GDH_Multi_Broadcast does not fit in a frame");
+	static_assert(GDH_Chain_Setup::MAX_ENTRIES >= 2, "GDH_Chain_Setup cannot carry a member and its successor");
+	static_assert(sizeof(GDH_Chain_Setup) - sizeof(Header) <= MTU, "GDH_Chain_Setup does not fit in a frame");
+	static_assert(sizeof(GDH_Join) - sizeof(Header) <= MTU, "GDH_Join does not fit in a frame");
+	static_assert(sizeof(GDH_Rekey) - sizeof(Header) <= MTU, "GDH_Rekey does not fit in a frame");
+	static_assert(sizeof(TGDH_Setup) - sizeof(Header) <= MTU, "TGDH_Setup does not fit in a frame");
+	static_assert(sizeof(TGDH_Blinded) - sizeof(Header) <= MTU, "TGDH_Blinded does not fit in a frame (Round_Key too large)");
+	static_assert(sizeof(BD_Setup) - sizeof(Header) <= MTU, "BD_Setup does not fit in a frame");
+	static_assert(sizeof(BD_Round) - sizeof(Header) <= MTU, "BD_Round does not fit in a frame (Round_Key too large)");
+
     // Report Control Message
     class Report: public Control
     {
@@ -1400,11 +1953,189 @@ public:
         }
     };
 
+    // Runs the key arithmetic triggered by received frames and by protocol timeouts, so the NIC receive path stays short
+    class Crypto_Worker
+    {
+        friend class TSTP;
+
+    public:
+        typedef void (Function)(Buffer * buf);
+
+        static const unsigned int FRAMES = 4; // received frames waiting to be processed
+        // A handler is queued at most once (see submit()) and cancel() frees its slot, so the queue never holds more than
+        // the distinct handlers: the frames, one timeout per live group, the GDH key pool refill and the release of ended groups
+        static const unsigned int JOBS = FRAMES + GDH_MAX_GROUPS + 2;
+
+    private:
+        // A received frame copied out of the NIC buffer, handled later by a Function
+        class Frame_Job: public Handler
+        {
+        public:
+            Frame_Job(): _function(0), _buffer(0, 0) {}
+
+            bool busy() const { return _function; }
+
+            void load(Crypto_Worker::Function * function, Buffer * buf) {
+                _function = function;
+                memcpy(_buffer.frame(), buf->frame(), sizeof(*buf->frame()));
+                _buffer.size(buf->size());
+            }
+            void unload() { _function = 0; }
+
+            void operator()() {
+                _function(&_buffer);
+                unload();
+            }
+
+        private:
+            Crypto_Worker::Function * volatile _function;
+            Buffer _buffer;
+        };
+
+    public:
+        static bool submit(Function * function, Buffer * buf);
+        static bool submit(Handler * job);
+        static void cancel(Handler * job);
+
+        static void priority(const Thread::Priority & p) { _thread->priority(p); }
+
+    private:
+        static void init();
+        static int work();
+
+    private:
+        static Frame_Job _frames[FRAMES];
+        static Handler * _jobs[JOBS];
+        static unsigned int _head;
+        static unsigned int _count;
+        static Semaphore _pending;
+        static Thread * _thread;
+    };
+
 	// TSTP Group Diffie Hellman Security component
     class GDH_Security: private NIC::Observer
     {
 		friend class TSTP;
 
+		class GDH_Context;
+		typedef Hash<GDH_Context, GDH_MAX_GROUPS, Group_Id> GDH_Contexts;
+
+		// Key agreement state of one group, looked up by the Group_Id carried in every GDH message
+		class GDH_Context
+		{
+			friend class GDH_Security;
+
+		public:
+			GDH_Context(const Group_Id & id): _node_type(GDH_FIRST), _state(GDH_WAITING_GW), _pending_responses(0),
+				_member_count(0), _partials_valid(false), _rekey_pending(false), _responded(0), _batch_count(0), _chain_received(0),
+				_started(TSTP::now()), _retained_size(0), _tries(0), _timeout_handler(&timeout, this), _expired_handler(&expired, this),
+				_alarm(0), _alarm_serial(0), _expired_serial(0), _link(this, id) {
+				new (_agreement) GDH;
+				_contexts.insert(&_link);
+			}
+			~GDH_Context() {
+				release();
+				_contexts.remove(&_link);
+				if(_alarm)
+					delete _alarm;
+				Crypto_Worker::cancel(&_timeout_handler);
+				while(!_next.empty()) {
+					List_Elements::Singly_Linked<Region::Space> * next = _next.remove_head();
+					delete next->object();
+					delete next;
+				}
+			}
+
+			const Group_Id & id() const { return _link.key(); }
+
+		private:
+			// The key agreement object of the group's mode, selected by _node_type: TGDH for GDH_TREE, BD for
+			// GDH_BURMESTER_DESMEDT and GDH for the chain roles. Each takes several KB, so only that one is built
+			GDH & gdh() { return *reinterpret_cast<GDH *>(_agreement); }
+			TGDH & tgdh() { return *reinterpret_cast<TGDH *>(_agreement); }
+			BD & bd() { return *reinterpret_cast<BD *>(_agreement); }
+
+			// A chain role (GDH_FIRST if the context held a TGDH or BD) is set by the caller afterwards
+			void chain(const GDH & gdh) {
+				release();
+				new (_agreement) GDH(gdh);
+				if((_node_type == GDH_TREE) || (_node_type == GDH_BURMESTER_DESMEDT))
+					_node_type = GDH_FIRST;
+			}
+			void tree(const TGDH & tgdh) {
+				release();
+				new (_agreement) TGDH(tgdh);
+				_node_type = GDH_TREE;
+			}
+			void burmester_desmedt(const BD & bd) {
+				release();
+				new (_agreement) BD(bd);
+				_node_type = GDH_BURMESTER_DESMEDT;
+			}
+
+			void release() {
+				if(_node_type == GDH_TREE)
+					tgdh().~TGDH();
+				else if(_node_type == GDH_BURMESTER_DESMEDT)
+					bd().~BD();
+				else
+					gdh().~GDH();
+			}
+
+		private:
+			union {
+				char _agreement[(sizeof(TGDH) > sizeof(BD)) ? sizeof(TGDH) : sizeof(BD)]; // TGDH and BD extend GDH
+				unsigned long long _alignment;
+			};
+			GDH_Node_Type _node_type;
+			GDH_State _state;
+			Simple_List<Region::Space> _next;
+			GDH::Shared_Key _key;
+			unsigned int _pending_responses;
+			Round_Key _round_key;
+			Region::Space _members[GDH_MAX_MEMBERS];
+			Round_Key _partial_keys[GDH_MAX_MEMBERS];
+			unsigned int _member_count;
+			bool _partials_valid;
+			bool _rekey_pending;
+			unsigned int _responded; // members whose GDH_Response the gateway already has (bitmap)
+			unsigned int _batch_count;
+			Region::Space _batch_members[GDH_Batch_Broadcast::ENTRIES];
+			Round_Key _batch_keys[GDH_Batch_Broadcast::ENTRIES];
+			unsigned int _chain_received; // chain members the last node already got from GDH_Chain_Setups (bitmap)
+			Region::Space _tree_siblings[TGDH_DEPTH];
+			Region::Space _bd_group;
+			Time _started;
+			unsigned char _retained[MTU]; // last message sent that expects an answer
+			unsigned int _retained_size;
+			unsigned int _tries;
+			Functor_Handler<GDH_Context> _timeout_handler; // runs timeout() in the Crypto_Worker
+			Functor_Handler<GDH_Context> _expired_handler; // run by _alarm
+			Alarm * _alarm;
+			unsigned int _alarm_serial; // bumped whenever _alarm is replaced or dropped
+			volatile unsigned int _expired_serial; // _alarm_serial when the last alarm fired
+
+			GDH_Contexts::Element _link;
+		};
+
+    public:
+		// Observers are notified with the Group_Id whenever that group's key is ready or the group fails
+		typedef Conditional_Observer<Group_Id> Key_Observer;
+		typedef Conditionally_Observed<Group_Id> Key_Observed;
+
+    private:
+		// Wakes up a thread blocked in wait_key()
+		class Key_Waiter: public Key_Observer
+		{
+		public:
+			Key_Waiter(Semaphore * sem): _sem(sem) {}
+
+			void update(Key_Observed * obs, Group_Id group_id) { _sem->v(); }
+
+		private:
+			Semaphore * _sem;
+		};
+
     public:
         GDH_Security() {
             db<TSTP>(TRC) << "TSTP::GDH_Security()" << endl;
@@ -1422,15 +2153,62 @@ public:
         void update(NIC::Observed * obs, NIC::Protocol prot, NIC::Buffer * buf);
 
 		static Group_Id begin_group_diffie_hellman(Simple_List<Region::Space> nodes);
+		static bool join_group(const Group_Id & group_id, const Region::Space & node);
+		static bool leave_group(const Group_Id & group_id, const Region::Space & node);
+		static Group_Id begin_tree_group_diffie_hellman(Simple_List<Region::Space> nodes);
+		static void refresh_tree_group_diffie_hellman(const Group_Id & group_id);
+		static Group_Id begin_burmester_desmedt(Simple_List<Region::Space> nodes);
+		static void end_group(const Group_Id & group_id);
+
+		static GDH::Shared_Key key(const Group_Id & group_id);
+		static bool ready(const Group_Id & group_id);
+		static bool wait_key(const Group_Id & group_id, const Microsecond & timeout = 0);
+
+		static void attach(Key_Observer * obs, const Group_Id & group_id) {
+			_lock.lock();
+			_key_observed.attach(obs, group_id);
+			_lock.unlock();
+		}
+		static void detach(Key_Observer * obs, const Group_Id & group_id) {
+			_lock.lock();
+			_key_observed.detach(obs, group_id);
+			_lock.unlock();
+		}
 
-		static Group_Diffie_Hellman::Shared_Key key() {return _GDH_key;}; //TODO GDH REMOVE THIS. TESTING ONLY!
+    private:
+		static GDH_Context * context(const Group_Id & group_id, bool create = false);
+		static Group_Id new_group_id();
+		static void transmit(GDH_Context * ctx, Buffer * buf);
+		static void process(Buffer * buf);
+		static void new_key(GDH_Context * ctx, const Parameters & params);
+		static void fill_key_pool();
+		static void flush_key_pool();
+		static void release();
+		static void set_timeout(GDH_Context * ctx);
+		static void expired(GDH_Context * ctx);
+		static void timeout(GDH_Context * ctx);
+		static void key_ready(GDH_Context * ctx, const GDH::Shared_Key & key);
+		static void flush_batch(GDH_Context * ctx);
+		static void chain_setup(GDH_Context * ctx);
+		static void chain_broadcast(GDH_Context * ctx, const Round_Key & round_key);
+		static void rekey(GDH_Context * ctx, const GDH::Shared_Key & key, const Region::Space & excluded);
+		static GDH::Shared_Key mask(const GDH::Shared_Key & key, const Group_Id & group_id);
+		static void tree_announce(GDH_Context * ctx, unsigned int from, unsigned int to, bool sponsor_only);
+		static void tree_siblings(Region::Space * siblings, const Region::Space * leaves, unsigned int leaf, unsigned int members);
+		static void bd_round(GDH_Context * ctx, const Subtype & subtype, const Round_Key & round_key);
 
     private:
-		static Group_Diffie_Hellman _gdh;
-		static GDH_State _GDH_state;
-		static GDH_Node_Type _GDH_node_type;
-		static Simple_List<Region::Space> _GDH_next;
-		static Group_Diffie_Hellman::Shared_Key _GDH_key;
+		static GDH_Contexts _contexts;
+		static Group_Id _last_group_id;
+		static Key_Observed _key_observed;
+		static GDH::Key_Pair _key_pool[GDH_KEY_POOL];
+		static Time _key_pool_times[GDH_KEY_POOL];
+		static Parameters _key_pool_parameters;
+		static volatile unsigned int _pooled_keys;
+		static Function_Handler _fill_key_pool_handler;
+		static Function_Handler _release_handler;
+		// Held by the public functions (application threads) and by the Crypto_Worker's jobs while they use the contexts
+		static Mutex _lock;
     };
 
     // TSTP Security
@@ -1560,6 +2338,8 @@ public:
         void update(NIC::Observed * obs, NIC::Protocol prot, NIC::Buffer * buf);
 
     private:
+        static void process(Buffer * buf);
+
         static void encrypt(const unsigned char * msg, const Peer * peer, unsigned char * out) {
             OTP key = otp(peer->master_secret(), peer->id());
             _cipher.encrypt(msg, key, out);
@@ -1803,7 +2583,8 @@ private:
                 return Region(sink(), 0, buf->frame()->data<Response>()->time(), buf->frame()->data<Response>()->expiry());
             case COMMAND:
                 return buf->frame()->data<Command>()->region();
-            case CONTROL:
+            case CONTROL: {
+                Region::Space space;
                 switch(buf->frame()->data<Control>()->subtype()) {
                     default:
                     case DH_RESPONSE:
@@ -1835,35 +2616,59 @@ private:
                     case EPOCH: {
                         return buf->frame()->data<Epoch>()->destination();
                     }
-					case GDH_SETUP_FIRST: {
-						Region::Space destination = buf->frame()->data<GDH_Setup_First>()->destination();
-						return Region(destination.center, destination.radius, buf->frame()->data<Header>()->time(), -1); //TODO is -1 okay?
-					}
-					case GDH_SETUP_INTERMEDIATE: {
-						Region::Space destination = buf->frame()->data<GDH_Setup_Intermediate>()->destination();
-						return Region(destination.center, destination.radius, buf->frame()->data<Header>()->time(), -1); //TODO is -1 okay?
-					}
-					case GDH_SETUP_LAST: {
-						Region::Space destination = buf->frame()->data<GDH_Setup_Last>()->destination();
-						return Region(destination.center, destination.radius, buf->frame()->data<Header>()->time(), -1); //TODO is -1 okay?
-					}
-					case GDH_SETUP_LAST_FOLLOW: {
-						Region::Space destination = buf->frame()->data<GDH_Setup_Last_Follow>()->destination();
-						return Region(destination.center, destination.radius, buf->frame()->data<Header>()->time(), -1); //TODO is -1 okay?
-					}
-					case GDH_ROUND: {
-						Region::Space destination = buf->frame()->data<GDH_Round>()->destination();
-						return Region(destination.center, destination.radius, buf->frame()->data<Header>()->time(), -1); //TODO is -1 okay?
-					}
-					case GDH_BROADCAST: {
-						Region::Space destination = buf->frame()->data<GDH_Broadcast>()->destination();
-						return Region(destination.center, destination.radius, buf->frame()->data<Header>()->time(), -1); //TODO is -1 okay?
-					}
-					case GDH_RESPONSE: {
-						Region::Space destination = buf->frame()->data<GDH_Response>()->destination();
-						return Region(destination.center, destination.radius, buf->frame()->data<Header>()->time(), -1); //TODO is -1 okay?
-					}
+					case GDH_SETUP_FIRST:
+						space = buf->frame()->data<GDH_Setup_First>()->destination();
+						break;
+					case GDH_SETUP_INTERMEDIATE:
+						space = buf->frame()->data<GDH_Setup_Intermediate>()->destination();
+						break;
+					case GDH_SETUP_LAST:
+						space = buf->frame()->data<GDH_Setup_Last>()->destination();
+						break;
+					case GDH_SETUP_LAST_FOLLOW:
+						space = buf->frame()->data<GDH_Setup_Last_Follow>()->destination();
+						break;
+					case GDH_ROUND:
+						space = buf->frame()->data<GDH_Round>()->destination();
+						break;
+					case GDH_BROADCAST:
+						space = buf->frame()->data<GDH_Broadcast>()->destination();
+						break;
+					case GDH_RESPONSE:
+						space = buf->frame()->data<GDH_Response>()->destination();
+						break;
+					case GDH_BATCH_BROADCAST:
+						space = buf->frame()->data<GDH_Batch_Broadcast>()->destination();
+						break;
+					case TGDH_SETUP:
+						space = buf->frame()->data<TGDH_Setup>()->destination();
+						break;
+					case TGDH_BLINDED:
+						space = buf->frame()->data<TGDH_Blinded>()->destination();
+						break;
+					case GDH_MULTI_BROADCAST:
+						space = buf->frame()->data<GDH_Multi_Broadcast>()->destination();
+						break;
+					case GDH_CHAIN_SETUP:
+						space = buf->frame()->data<GDH_Chain_Setup>()->destination();
+						break;
+					case GDH_JOIN:
+						space = buf->frame()->data<GDH_Join>()->destination();
+						break;
+					case GDH_REKEY:
+						space = buf->frame()->data<GDH_Rekey>()->destination();
+						break;
+					case BD_SETUP:
+						space = buf->frame()->data<BD_Setup>()->destination();
+						break;
+					case BD_FIRST_ROUND:
+					case BD_SECOND_ROUND:
+						space = buf->frame()->data<BD_Round>()->destination();
+						break;
                 }
+                //every GDH message is destined to a space and lives for one GDH_TIMEOUT
+                return Region(space.center, space.radius, buf->frame()->data<Header>()->time(), buf->frame()->data<Header>()->time() + GDH_TIMEOUT);
+            }
             default:
                 db<TSTP>(ERR) << "TSTP::destination(): ERROR: unrecognized frame type " << buf->frame()->data<Frame>()->type() << endl;
                 return Region(TSTP::here(), 0, TSTP::now() - 2, TSTP::now() - 1);
@@ -7,16 +7,106 @@
 
 __BEGIN_UTIL
 
+// Type that holds the product of two Digits, for each Digit type supported by Bignum
+template<typename Digit>
+struct Bignum_Double_Digit;
+
+template<>
+struct Bignum_Double_Digit<unsigned int> { typedef unsigned long long Type; };
+
+#ifdef __SIZEOF_INT128__
+template<>
+struct Bignum_Double_Digit<unsigned long long> { typedef unsigned __int128 Type; };
+#endif
+
+// Fully unrolled kernels for the fixed-size Bignum operations (see Traits<Bignums>::UNROLLED)
+// Each step handles digit I and recurses into digit I + 1, so a whole N-digit loop collapses at compile time
+// Bignum_Unrolled<Digit, Double_Digit, N, N> ends the recursion (and, with N = 0, disables the kernels)
+template<typename Digit, typename Double_Digit, unsigned int I, unsigned int N>
+struct Bignum_Unrolled
+{
+    typedef Bignum_Unrolled<Digit, Double_Digit, I + 1, N> Next;
+    typedef Bignum_Unrolled<Digit, Double_Digit, 0, N> First;
+
+    static const unsigned int BITS_PER_DIGIT = sizeof(Digit) * 8;
+
+    // res[I..N) = a[I..N) + b[I..N) + carry, returns the carry out
+    static Digit add(Digit * res, const Digit * a, const Digit * b, Digit carry) __attribute__((always_inline)) {
+        Double_Digit tmp = Double_Digit(a[I]) + b[I] + carry;
+        res[I] = tmp;
+        return Next::add(res, a, b, Digit(tmp >> BITS_PER_DIGIT));
+    }
+
+    // res[I..N) = a[I..N) - b[I..N) - borrow, returns the borrow out (without branches)
+    static Digit sub(Digit * res, const Digit * a, const Digit * b, Digit borrow) __attribute__((always_inline)) {
+        Double_Digit tmp = Double_Digit(a[I]) - b[I] - borrow;
+        res[I] = tmp;
+        return Next::sub(res, a, b, Digit(tmp >> BITS_PER_DIGIT) & 1);
+    }
+
+    // a[0..N - I) against b[0..N - I), from the top digit down: a == b -> 0, a > b -> 1, a < b -> -1
+    static int cmp(const Digit * a, const Digit * b) __attribute__((always_inline)) {
+        if(a[N - 1 - I] != b[N - 1 - I])
+            return (a[N - 1 - I] > b[N - 1 - I]) ? 1 : -1;
+        return Next::cmp(a, b);
+    }
+
+    // r[I..N) += a[I..N) * d + carry, returns the carry out
+    static Digit mac(Digit * r, const Digit * a, Digit d, Digit carry) __attribute__((always_inline)) {
+        Double_Digit tmp = Double_Digit(r[I]) + Double_Digit(a[I]) * d + carry;
+        r[I] = tmp;
+        return Next::mac(r, a, d, Digit(tmp >> BITS_PER_DIGIT));
+    }
+
+    // res[I..I + N] = res[I..I + N) + a * b[I], for each remaining row (res[0..N) must start cleared)
+    static void mult(Digit * res, const Digit * a, const Digit * b) __attribute__((always_inline)) {
+        res[I + N] = First::mac(res + I, a, b[I], 0);
+        Next::mult(res, a, b);
+    }
+
+    // res[I..N) += a * b[I] % base^(N - I), for each remaining row: res = (a * b) % base^N if res starts cleared
+    static void mult_low(Digit * res, const Digit * a, const Digit * b) __attribute__((always_inline)) {
+        Bignum_Unrolled<Digit, Double_Digit, 0, N - I>::mac(res + I, a, b[I], 0);
+        Next::mult_low(res, a, b);
+    }
+
+    // t += m * mod * base^I, with m chosen so that t[I] vanishes, for each remaining row; returns the overflow
+    // out of t[2 * N - 1] (see Bignum::montgomery_reduction())
+    static Digit reduction(Digit * t, const Digit * mod, Digit n0, Digit overflow) __attribute__((always_inline)) {
+        Digit m = t[I] * n0;
+        Double_Digit tmp = Double_Digit(t[I + N]) + First::mac(t + I, mod, m, 0) + overflow;
+        t[I + N] = tmp;
+        return Next::reduction(t, mod, n0, Digit(tmp >> BITS_PER_DIGIT));
+    }
+};
+
+template<typename Digit, typename Double_Digit, unsigned int N>
+struct Bignum_Unrolled<Digit, Double_Digit, N, N>
+{
+    static Digit add(Digit * res, const Digit * a, const Digit * b, Digit carry) { return carry; }
+    static Digit sub(Digit * res, const Digit * a, const Digit * b, Digit borrow) { return borrow; }
+    static int cmp(const Digit * a, const Digit * b) { return 0; }
+    static Digit mac(Digit * r, const Digit * a, Digit d, Digit carry) { return carry; }
+    static void mult(Digit * res, const Digit * a, const Digit * b) {}
+    static void mult_low(Digit * res, const Digit * a, const Digit * b) {}
+    static Digit reduction(Digit * t, const Digit * mod, Digit n0, Digit overflow) { return overflow; }
+};
+
 // This class implements a prime finite field (Fp or GF(p))
 // It basically consists of (possibly) big numbers between 0 and a prime modulo, with + - * / operators
 // Primarily meant to be used primarily by asymmetric cryptography (e.g. Diffie-Hellman)
-template<unsigned int SIZE>
+// Digits are 32-bit by default; Traits<Bignums>::DIGIT_SIZE = 8 selects 64-bit ones where the compiler has a
+// 128-bit type, which takes a quarter of the digit multiplications
+// Bignums of up to 16 digits use the fully unrolled Bignum_Unrolled kernels unless Traits<Bignums>::UNROLLED is
+// false, in which case every size shares the out-of-line loops (smaller, for when flash is scarce)
+template<unsigned int SIZE, typename D = typename IF<Traits<Bignums>::DIGIT_SIZE == 8, unsigned long long, unsigned int>::Result>
 class Bignum
 {
     friend class _SYS::Poly1305;
+    template<unsigned int> friend class _SYS::Group_Diffie_Hellman_Common;
 public:
-    typedef unsigned int Digit;
-    typedef unsigned long long Double_Digit;
+    typedef D Digit;
+    typedef typename Bignum_Double_Digit<D>::Type Double_Digit;
 
     static const unsigned int DIGITS = (SIZE + sizeof(Digit) - 1) / sizeof(Digit);
     static const unsigned int BITS_PER_DIGIT = sizeof(Digit) * 8;
@@ -25,24 +115,34 @@ public:
     typedef Double_Digit Double_Word[DIGITS];
 
 private:
+    static const bool UNROLLED = Traits<Bignums>::UNROLLED && (DIGITS <= 16);
+    typedef Bignum_Unrolled<Digit, Double_Digit, 0, (UNROLLED ? DIGITS : 0)> Unrolled;
+    typedef Bignum_Unrolled<Digit, Double_Digit, 0, (UNROLLED ? DIGITS + 1 : 0)> Unrolled_Wide; // for barrett_reduction()
+
+    // Bignum<16>'s _mod is SECG's secp128r1 prime p = 2^128 - 2^97 - 1 (see bignum.cc), so reduction() picks
+    // secp128r1_reduction() for it at compile time instead of barrett_reduction()
+    // - Only with 32-bit digits: secp128r1_reduction() works on 32-bit words, and with 64-bit digits (and their
+    //   128-bit products) the unrolled barrett_reduction() is about twice as fast
+    static const bool SECP128R1 = (SIZE == 16) && (sizeof(Digit) == sizeof(unsigned int));
+
     union _Word {
         unsigned char bytes[sizeof(Word)];
-        Digit data[];
+        Digit data[DIGITS];
     };
     union _Barrett {
         unsigned char bytes[sizeof(Word) + sizeof(Digit)];
-        Digit data[];
+        Digit data[DIGITS + 1];
     };
 
 public:
-    Bignum(unsigned int n = 0) __attribute__((noinline)) {
+    Bignum(unsigned int n = 0) {
         *this = n;
     }
     Bignum(const unsigned char * bytes, unsigned int len) {
         for(unsigned int i = 0, j = 0; i < DIGITS; i++) {
             _data[i] = 0;
             for(unsigned int k = 0; k < sizeof(Digit) && j < len; k++, j++)
-                _data[i] += (bytes[j] << (8 * k));
+                _data[i] += (Digit(bytes[j]) << (8 * k));
         }
     }
 
@@ -86,7 +186,7 @@ public:
     bool  operator>(const Bignum & b) const { return (cmp(_data, b._data, DIGITS) > 0); }
     bool  operator<(const Bignum & b) const { return (cmp(_data, b._data, DIGITS) < 0); }
 
-    void operator*=(const Bignum & b) __attribute__((noinline)) { // _data = (_data * b._data) % _mod
+    void operator*=(const Bignum & b) { // _data = (_data * b._data) % _mod
         if(b == 1) return;
 
         if(Traits<Bignum>::hysterically_debugged) {
@@ -98,13 +198,19 @@ public:
 
         Digit mult_result[2 * DIGITS];
         simple_mult(mult_result, _data, b._data, DIGITS);
-        barrett_reduction(_data, mult_result, DIGITS);
+        reduction(_data, mult_result);
 
         if(Traits<Bignum>::hysterically_debugged)
             db<Bignum>(TRC) << *this << endl;
     }
 
-    void operator+=(const Bignum &b)__attribute__((noinline)) { // _data = (_data + b._data) % _mod
+    void square() { // _data = (_data * _data) % _mod
+        Digit square_result[2 * DIGITS];
+        simple_square(square_result, _data, DIGITS);
+        reduction(_data, square_result);
+    }
+
+    void operator+=(const Bignum &b) { // _data = (_data + b._data) % _mod
         if(Traits<Bignum>::hysterically_debugged) {
             db<Bignum>(TRC) << "Bignum::operator+=(this=" << *this << ",other=" << b << ",mod=[";
             for(unsigned int i = 0; i < DIGITS - 1; i++)
@@ -121,7 +227,7 @@ public:
             db<Bignum>(TRC) << *this << endl;
     }
 
-    void operator-=(const Bignum &b)__attribute__((noinline)) { // _data = (_data - b._data) % _mod
+    void operator-=(const Bignum &b) { // _data = (_data - b._data) % _mod
         if(Traits<Bignum>::hysterically_debugged) {
             db<Bignum>(TRC) << "Bignum::operator-=(this=" << *this << ",other=" << b << ",mod=[";
             for(unsigned int i = 0; i < DIGITS - 1; i++)
@@ -136,10 +242,32 @@ public:
             db<Bignum>(TRC) << *this << endl;
     }
 
+    // Montgomery representation: keeps a as (a * R) % _mod, with R = base^DIGITS
+    // montgomery_multiply() multiplies and reduces in a single CIOS pass (montgomery_mult()) instead of a
+    // simple_mult() plus a barrett_reduction(), so long chains of products are worth a to_montgomery() before
+    // and a from_montgomery() after them. Sums and differences work unchanged on the representation
+    // - Only for moduli with _montgomery_r2 and _montgomery_n0 defined (see bignum.cc)
+    void to_montgomery() { montgomery_mult(_data, _data, _montgomery_r2.data, _mod.data, Digit(_montgomery_n0), DIGITS); }
+
+    void from_montgomery() {
+        Bignum one(1);
+        montgomery_mult(_data, _data, one._data, _mod.data, Digit(_montgomery_n0), DIGITS);
+    }
+
+    void montgomery_multiply(const Bignum & b) { // _data = (_data * b._data * R^(-1)) % _mod
+        montgomery_mult(_data, _data, b._data, _mod.data, Digit(_montgomery_n0), DIGITS);
+    }
+
+    void montgomery_square() { // _data = (_data * _data * R^(-1)) % _mod
+        Digit square_result[2 * DIGITS];
+        simple_square(square_result, _data, DIGITS);
+        montgomery_reduction(_data, square_result, _mod.data, Digit(_montgomery_n0), DIGITS);
+    }
+
     // Shift left (actually shift right, because of little endianness)
     // - Does not apply modulo
     // - Returns carry bit
-    bool multiply_by_two(bool carry = 0) __attribute__((noinline))
+    bool multiply_by_two(bool carry = 0)
     {
         if(Traits<Bignum>::hysterically_debugged && !carry) {
             db<Bignum>(TRC) << "Bignum::multiply_by_two(this=" << *this << ",mod=[";
@@ -165,7 +293,7 @@ public:
     // Shift right (actually shift left, because of little endianness)
     // - Does not apply modulo
     // - Returns carry bit
-    bool divide_by_two(bool carry = 0) __attribute__((noinline))
+    bool divide_by_two(bool carry = 0)
     {
         if(Traits<Bignum>::hysterically_debugged && !carry) {
             db<Bignum>(TRC) << "Bignum::divide_by_two(this=" << *this << ",mod=[";
@@ -192,9 +320,17 @@ public:
         int i;
         for(i = DIGITS - 1; i >= 0 && (_mod.data[i] == 0); i--)
             _data[i]=0;
-        _data[i] = Random::random() % _mod.data[i];
+        _data[i] = random_digit() % _mod.data[i];
         for(--i; i >= 0; i--)
-            _data[i] = Random::random();
+            _data[i] = random_digit();
+    }
+
+    // A random Digit, from as many Random::random() calls as it takes
+    static Digit random_digit() {
+        Digit d = 0;
+        for(unsigned int i = 0; i < sizeof(Digit); i += sizeof(unsigned int))
+            d = (d << 16 << 16) | static_cast<unsigned int>(Random::random());
+        return d;
     }
 
     void invert() __attribute__((noinline)) { // _data = i, such that (_data * i) % _mod = 1
@@ -238,7 +374,7 @@ public:
         unsigned int i;
         out << '[';
         for(i=0;i<DIGITS;i++) {
-            out << (unsigned int)b._data[i];
+            out << b._data[i];
             if(i < DIGITS-1)
                 out << ", ";
         }
@@ -250,7 +386,7 @@ public:
         unsigned int i;
         out << '[';
         for(i = 0; i < DIGITS; i++) {
-            out << (unsigned int)b._data[i];
+            out << b._data[i];
             if(i < DIGITS - 1)
                 out << ", ";
         }
@@ -259,7 +395,37 @@ public:
     }
 
 private:
+    // The kernels below take their size at run time; when it is DIGITS (always, after inlining, for the
+    // operators above) they use the Unrolled ones, otherwise the out-of-line *_loop() versions
+
     static int cmp(const Digit * a, const Digit * b, int size) { // a == b -> 0, a > b -> 1, a < b -> -1
+        if(UNROLLED && (size == int(DIGITS)))
+            return Unrolled::cmp(a, b);
+        return cmp_loop(a, b, size);
+    }
+
+    static bool simple_sub(Digit * res, const Digit * a, const Digit * b, unsigned int size) {
+        if(UNROLLED && (size == DIGITS))
+            return Unrolled::sub(res, a, b, 0);
+        return simple_sub_loop(res, a, b, size);
+    }
+
+    static bool simple_add(Digit * res, const Digit * a, const Digit * b, unsigned int size) {
+        if(UNROLLED && (size == DIGITS))
+            return Unrolled::add(res, a, b, 0);
+        return simple_add_loop(res, a, b, size);
+    }
+
+    static void simple_mult(Digit * res, const Digit * a, const Digit * b, unsigned int size) {
+        if(UNROLLED && (size == DIGITS)) {
+            for(unsigned int i = 0; i < DIGITS; i++)
+                res[i] = 0;
+            Unrolled::mult(res, a, b);
+        } else
+            simple_mult_loop(res, a, b, size);
+    }
+
+    static int cmp_loop(const Digit * a, const Digit * b, int size) __attribute__((noinline)) {
         for(int i = size - 1; i >= 0; i--) {
             if(a[i] > b[i]) return 1;
             else if(a[i] < b[i]) return -1;
@@ -272,7 +438,7 @@ private:
     // -No modulo applied
     // -a, b and res are assumed to have size 'size'
     // -a, b, res are allowed to point to the same place
-    static bool simple_sub(Digit * res, const Digit * a, const Digit * b, unsigned int size) __attribute__((noinline)) {
+    static bool simple_sub_loop(Digit * res, const Digit * a, const Digit * b, unsigned int size) __attribute__((noinline)) {
         Double_Digit borrow = 0;
         Double_Digit aux = Double_Digit(1) << BITS_PER_DIGIT;
         for(unsigned int i = 0; i < size; i++) {
@@ -289,7 +455,7 @@ private:
     // -No modulo applied
     // -a, b and res are assumed to have size 'size'
     // -a, b, res are allowed to point to the same place
-    static bool simple_add(Digit * res, const Digit * a, const Digit * b, unsigned int size) __attribute__((noinline)) {
+    static bool simple_add_loop(Digit * res, const Digit * a, const Digit * b, unsigned int size) __attribute__((noinline)) {
         bool carry = 0;
         for(unsigned int i = 0; i < size; i++) {
             Double_Digit tmp = Double_Digit(carry) + Double_Digit(a[i]) + Double_Digit(b[i]);
@@ -303,7 +469,7 @@ private:
     // - Does not apply module
     // - a and b are assumed to be of size 'size'
     // - res is assumed to be of size '2*size'
-    static void simple_mult(Digit * res, const Digit * a, const Digit * b, unsigned int size) {
+    static void simple_mult_loop(Digit * res, const Digit * a, const Digit * b, unsigned int size) __attribute__((noinline)) {
         unsigned int i;
         Double_Digit r0 = 0, r1 = 0, r2 = 0;
         for(i = 0; i < size * 2 - 1; i++) {
@@ -328,11 +494,132 @@ private:
         res[i] = r0;
     }
 
+    // res = (a * a)
+    // - Does not apply module
+    // - Each cross product a[i] * a[j] (i != j) is computed once and doubled, so it takes about half
+    //   the digit multiplications of simple_mult()
+    // - a is assumed to be of size 'size'
+    // - res is assumed to be of size '2*size' and must not overlap a
+    static void simple_square(Digit * res, const Digit * a, unsigned int size) {
+        // res = sum of a[i] * a[j] * base^(i + j) for i < j
+        for(unsigned int i = 0; i < 2 * size; i++)
+            res[i] = 0;
+        for(unsigned int i = 0; i < size; i++) {
+            Double_Digit carry = 0;
+            for(unsigned int j = i + 1; j < size; j++) {
+                Double_Digit tmp = Double_Digit(res[i + j]) + Double_Digit(a[i]) * a[j] + carry;
+                res[i + j] = tmp;
+                carry = tmp >> BITS_PER_DIGIT;
+            }
+            res[i + size] = carry;
+        }
+
+        // res = 2 * res + sum of a[i]^2 * base^(2 * i)
+        Digit top = 0;
+        for(unsigned int i = 0; i < 2 * size; i++) {
+            Digit d = res[i];
+            res[i] = (d << 1) | top;
+            top = d >> (BITS_PER_DIGIT - 1);
+        }
+        Double_Digit carry = 0;
+        for(unsigned int i = 0; i < size; i++) {
+            Double_Digit square = Double_Digit(a[i]) * a[i];
+            Double_Digit tmp = Double_Digit(res[2 * i]) + Digit(square) + carry;
+            res[2 * i] = tmp;
+            carry = tmp >> BITS_PER_DIGIT;
+            tmp = Double_Digit(res[2 * i + 1]) + (square >> BITS_PER_DIGIT) + carry;
+            res[2 * i + 1] = tmp;
+            carry = tmp >> BITS_PER_DIGIT;
+        }
+    }
+
+    // res = a % _mod
+    // - Intended to be used after a multiplication
+    // - res is assumed to be of size 'DIGITS'
+    // - a is assumed to be of size '2*DIGITS'
+    void reduction(Digit * res, const Digit * a) {
+        if(SECP128R1)
+            secp128r1_reduction(res, a);
+        else
+            barrett_reduction(res, a, DIGITS);
+    }
+
+    // res = a % p, for p = 2^128 - 2^97 - 1 (i.e. _mod, if SECP128R1)
+    // - a is assumed to be of size '2*DIGITS' (256 bits) and res of size 'DIGITS' (128 bits)
+    // - Since 2^128 = 2^97 + 1 (mod p), each 32-bit word of a above bit 128 is worth a few shifted copies of itself
+    //   below it, so it takes only shifts and additions (and no digit multiplications, unlike barrett_reduction())
+    static void secp128r1_reduction(Digit * res, const Digit * a) {
+        static const unsigned int WORDS_PER_DIGIT = sizeof(Digit) / sizeof(unsigned int);
+
+        unsigned int w[8];
+        for(unsigned int i = 0; i < 8; i++)
+            w[i] = a[i / WORDS_PER_DIGIT] >> (32 * (i % WORDS_PER_DIGIT));
+
+        // acc = a, with (mod p):
+        // 2^128 = 2^97 + 1
+        // 2^160 = 2^98 + 2^32 + 2
+        // 2^192 = 2^99 + 2^64 + 2^33 + 4
+        // 2^224 = 2^100 + 2^96 + 2^65 + 2^34 + 8
+        // Each acc[i] gathers the 32-bit words that land on bits [32 * i, 32 * i + 32), with room for their carries
+        unsigned long long acc[5] = { w[0], w[1], w[2], w[3], 0 };
+        secp128r1_accumulate(acc, w[4], 97);
+        secp128r1_accumulate(acc, w[4], 0);
+        secp128r1_accumulate(acc, w[5], 98);
+        secp128r1_accumulate(acc, w[5], 32);
+        secp128r1_accumulate(acc, w[5], 1);
+        secp128r1_accumulate(acc, w[6], 99);
+        secp128r1_accumulate(acc, w[6], 64);
+        secp128r1_accumulate(acc, w[6], 33);
+        secp128r1_accumulate(acc, w[6], 2);
+        secp128r1_accumulate(acc, w[7], 100);
+        secp128r1_accumulate(acc, w[7], 96);
+        secp128r1_accumulate(acc, w[7], 65);
+        secp128r1_accumulate(acc, w[7], 34);
+        secp128r1_accumulate(acc, w[7], 3);
+
+        // acc < 2^134: fold what is above 2^128 back in the same way; the first fold leaves at most 2^128 + 2^103,
+        // so the second one (which only adds something in that case) ends below 2^128 < 2 * p
+        for(unsigned int fold = 0; fold < 2; fold++) {
+            for(unsigned int i = 0; i < 4; i++) {
+                acc[i + 1] += acc[i] >> 32;
+                acc[i] &= 0xffffffff;
+            }
+            unsigned int top = acc[4];
+            acc[4] = 0;
+            secp128r1_accumulate(acc, top, 97);
+            secp128r1_accumulate(acc, top, 0);
+        }
+        for(unsigned int i = 0; i < 3; i++) {
+            acc[i + 1] += acc[i] >> 32;
+            acc[i] &= 0xffffffff;
+        }
+
+        for(unsigned int i = 0; i < 4 / WORDS_PER_DIGIT; i++) {
+            res[i] = 0;
+            for(unsigned int j = 0; j < WORDS_PER_DIGIT; j++)
+                res[i] |= Digit(acc[i * WORDS_PER_DIGIT + j]) << (32 * j);
+        }
+        if(cmp(res, _mod.data, DIGITS) >= 0)
+            simple_sub(res, res, _mod.data, DIGITS);
+    }
+
+    // acc += w * 2^shift, for shift < 128, keeping 32 bits of value per acc[i]
+    static void secp128r1_accumulate(unsigned long long * acc, unsigned int w, unsigned int shift) {
+        unsigned long long v = static_cast<unsigned long long>(w) << (shift % 32);
+        acc[shift / 32] += static_cast<unsigned int>(v);
+        acc[shift / 32 + 1] += v >> 32;
+    }
+
     // res = a % _mod
     // - Intended to be used after a multiplication
     // - res is assumed to be of size 'size'
     // - a is assumed to be of size '2*size'
     void barrett_reduction(Digit * res, const Digit * a, unsigned int size) {
+        if(UNROLLED && (size == DIGITS)) {
+            barrett_reduction_unrolled(res, a);
+            return;
+        }
+
         Digit q[size + 1];
 
         // q = floor( ( floor( a/base^(size-1) ) * barrett_u ) / base^(size+1))
@@ -397,11 +684,160 @@ private:
             res[i] = r[i];
     }
 
+    // barrett_reduction() for size = DIGITS, through the Unrolled kernels
+    // - The second product only computes the DIGITS + 1 digits that are kept
+    void barrett_reduction_unrolled(Digit * res, const Digit * a) {
+        // q = floor( ( floor( a/base^(DIGITS-1) ) * barrett_u ) / base^(DIGITS+1))
+        Digit q2[2 * (DIGITS + 1)];
+        for(unsigned int i = 0; i < DIGITS + 1; i++)
+            q2[i] = 0;
+        Unrolled_Wide::mult(q2, a + (DIGITS - 1), _barrett_u.data);
+        const Digit * q = &q2[DIGITS + 1];
+
+        // r = (q * _mod) % base^(DIGITS+1)
+        Digit m[DIGITS + 1];
+        Digit r[DIGITS + 1];
+        for(unsigned int i = 0; i < DIGITS; i++) {
+            m[i] = _mod.data[i];
+            r[i] = 0;
+        }
+        m[DIGITS] = 0;
+        r[DIGITS] = 0;
+        Unrolled_Wide::mult_low(r, q, m);
+
+        // r = ((a % base^(DIGITS+1)) - r) % base^(DIGITS+1)
+        Unrolled_Wide::sub(r, a, r, 0);
+
+        // _data = r % _mod
+        while((r[DIGITS] > 0) || (cmp(r, _mod.data, DIGITS) >= 0)) {
+            if(simple_sub(r, r, _mod.data, DIGITS))
+                r[DIGITS]--;
+        }
+
+        for(unsigned int i = 0; i < DIGITS; i++)
+            res[i] = r[i];
+    }
+
+    // Returns i, such that (d * i) % base = 1
+    // - d must be odd
+    static Digit digit_inverse(Digit d) {
+        Digit i = d; // d * d = 1 (mod 8) for any odd d, so i starts with 3 correct bits
+        for(unsigned int bits = 3; bits < BITS_PER_DIGIT; bits *= 2)
+            i *= 2 - d * i;
+        return i;
+    }
+
+    // res = (a * b * base^(-size)) % mod (Montgomery multiplication, Coarsely Integrated Operand Scanning)
+    // - mod must be odd and n0 = -(mod^(-1)) % base
+    // - a, b, mod and res are assumed to have size 'size'
+    // - b is assumed to be smaller than mod
+    // - a, b, res are allowed to point to the same place
+    // - Unrolled, it is a simple_mult() followed by a montgomery_reduction(), which takes the same digit multiplications
+    static void montgomery_mult(Digit * res, const Digit * a, const Digit * b, const Digit * mod, Digit n0, unsigned int size) {
+        if(UNROLLED && (size == DIGITS)) {
+            Digit product[2 * DIGITS];
+            simple_mult(product, a, b, DIGITS);
+            montgomery_reduction(res, product, mod, n0, DIGITS);
+            return;
+        }
+
+        Digit t[size + 2];
+        for(unsigned int i = 0; i < size + 2; i++)
+            t[i] = 0;
+
+        for(unsigned int i = 0; i < size; i++) {
+            // t += a * b[i]
+            Double_Digit carry = 0;
+            for(unsigned int j = 0; j < size; j++) {
+                Double_Digit tmp = Double_Digit(t[j]) + Double_Digit(a[j]) * b[i] + carry;
+                t[j] = tmp;
+                carry = tmp >> BITS_PER_DIGIT;
+            }
+            Double_Digit tmp = Double_Digit(t[size]) + carry;
+            t[size] = tmp;
+            t[size + 1] = tmp >> BITS_PER_DIGIT;
+
+            // t = (t + m * mod) / base, with m chosen so that the lowest digit vanishes
+            Digit m = t[0] * n0;
+            tmp = Double_Digit(t[0]) + Double_Digit(m) * mod[0];
+            carry = tmp >> BITS_PER_DIGIT;
+            for(unsigned int j = 1; j < size; j++) {
+                tmp = Double_Digit(t[j]) + Double_Digit(m) * mod[j] + carry;
+                t[j - 1] = tmp;
+                carry = tmp >> BITS_PER_DIGIT;
+            }
+            tmp = Double_Digit(t[size]) + carry;
+            t[size - 1] = tmp;
+            t[size] = t[size + 1] + Digit(tmp >> BITS_PER_DIGIT);
+        }
+
+        // t < 2 * mod: res = t - mod unless that borrows (with t[size] clear), selected through a mask
+        // rather than a branch or an early-exit cmp(), so the running time doesn't depend on the operands
+        Digit u[size];
+        Double_Digit borrow = 0;
+        for(unsigned int i = 0; i < size; i++) {
+            Double_Digit tmp = Double_Digit(t[i]) - mod[i] - borrow;
+            u[i] = tmp;
+            borrow = (tmp >> BITS_PER_DIGIT) & 1;
+        }
+        Digit keep = -Digit(borrow & (t[size] ^ 1));
+
+        for(unsigned int i = 0; i < size; i++)
+            res[i] = (t[i] & keep) | (u[i] & ~keep);
+    }
+
+    // res = (a * base^(-size)) % mod (Montgomery reduction)
+    // - mod must be odd and n0 = -(mod^(-1)) % base
+    // - a is assumed to be of size '2*size' and smaller than mod * base^size (e.g. a product of numbers smaller than mod)
+    // - res is assumed to be of size 'size'
+    static void montgomery_reduction(Digit * res, const Digit * a, const Digit * mod, Digit n0, unsigned int size) {
+        Digit t[2 * size + 1];
+        for(unsigned int i = 0; i < 2 * size; i++)
+            t[i] = a[i];
+        t[2 * size] = 0;
+
+        // t += m * mod * base^i, with m chosen so that t[i] vanishes; the carry out of t[i + size] is added in the next round
+        if(UNROLLED && (size == DIGITS))
+            t[2 * size] = Unrolled::reduction(t, mod, n0, 0);
+        else {
+            Double_Digit overflow = 0;
+            for(unsigned int i = 0; i < size; i++) {
+                Digit m = t[i] * n0;
+                Double_Digit carry = 0;
+                for(unsigned int j = 0; j < size; j++) {
+                    Double_Digit tmp = Double_Digit(t[i + j]) + Double_Digit(m) * mod[j] + carry;
+                    t[i + j] = tmp;
+                    carry = tmp >> BITS_PER_DIGIT;
+                }
+                Double_Digit tmp = Double_Digit(t[i + size]) + carry + overflow;
+                t[i + size] = tmp;
+                overflow = tmp >> BITS_PER_DIGIT;
+            }
+            t[2 * size] = overflow;
+        }
+
+        // t[size..2 * size] < 2 * mod: the same branch-free final subtraction as montgomery_mult()
+        Digit * r = &t[size];
+        Digit u[size];
+        Double_Digit borrow = 0;
+        for(unsigned int i = 0; i < size; i++) {
+            Double_Digit tmp = Double_Digit(r[i]) - mod[i] - borrow;
+            u[i] = tmp;
+            borrow = (tmp >> BITS_PER_DIGIT) & 1;
+        }
+        Digit keep = -Digit(borrow & (r[size] ^ 1));
+
+        for(unsigned int i = 0; i < size; i++)
+            res[i] = (r[i] & keep) | (u[i] & ~keep);
+    }
+
 private:
     Word _data;
 
     static const _Word _mod;
     static const _Barrett _barrett_u;
+    static const _Word _montgomery_r2; // R^2 % _mod
+    static const unsigned long long _montgomery_n0; // -(_mod^(-1)) % 2^64, truncated to a Digit
 };
 
 __END_UTIL
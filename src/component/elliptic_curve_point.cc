@@ -21,6 +21,11 @@ void Elliptic_Curve_Point::operator*=(const Coordinate & b)
     bool bin[bits_in_digit]; // Binary representation of 'now'
     unsigned int current_bit = bits_in_digit;
 
+    // Coordinates stay in Montgomery representation until the point is normalized
+    x.to_montgomery();
+    y.to_montgomery();
+    z.to_montgomery();
+
     Elliptic_Curve_Point pp(*this);
 
     for(int i = bits_in_digit - 1; i >= 0; i--) {
@@ -46,10 +51,14 @@ void Elliptic_Curve_Point::operator*=(const Coordinate & b)
         }
     }
 
+    x.from_montgomery();
+    y.from_montgomery();
+    z.from_montgomery();
+
     Coordinate Z;
     z.invert();
     Z = z;
-    Z *= z;
+    Z.square();
 
     x *= Z;
     Z *= z;
@@ -58,27 +67,29 @@ void Elliptic_Curve_Point::operator*=(const Coordinate & b)
     z = 1;
 }
 
+// Both formulas work on coordinates in Montgomery representation
+// Multiplications by small constants are done as additions and squares through montgomery_square()
 void Elliptic_Curve_Point::jacobian_double()
 {
     Coordinate B, C(x), aux(z);
 
-    aux *= z; C -= aux;
-    aux += x; C *= aux;
-    C *= 3;
+    aux.montgomery_square(); C -= aux;
+    aux += x; C.montgomery_multiply(aux);
+    aux = C; C += aux; C += aux; // C *= 3
 
-    z *= y; z *= 2;
+    z.montgomery_multiply(y); z += z; // z *= 2
 
-    y *= y; B = y;
+    y.montgomery_square(); B = y;
 
-    y *= x; y *= 4;
+    y.montgomery_multiply(x); y += y; y += y; // y *= 4
 
-    B *= B; B *= 8;
+    B.montgomery_square(); B += B; B += B; B += B; // B *= 8
 
-    x = C; x *= x;
-    aux = y; aux *= 2;
+    x = C; x.montgomery_square();
+    aux = y; aux += aux;
     x -= aux;
 
-    y -= x; y *= C;
+    y -= x; y.montgomery_multiply(C);
     y -= B;
 }
 
@@ -86,33 +97,33 @@ void Elliptic_Curve_Point::add_jacobian_affine(const Elliptic_Curve_Point &b)
 {
     Coordinate A(z), B, C, X, Y, aux, aux2;
 
-    A *= z;
+    A.montgomery_square();
 
     B = A;
 
-    A *= b.x;
+    A.montgomery_multiply(b.x);
 
-    B *= z; B *= b.y;
+    B.montgomery_multiply(z); B.montgomery_multiply(b.y);
 
     C = A; C -= x;
 
     B -= y;
 
-    X = B; X *= B;
-    aux = C; aux *= C;
+    X = B; X.montgomery_square();
+    aux = C; aux.montgomery_square();
 
     Y = aux;
 
-    aux2 = aux; aux *= C;
-    aux2 *= 2; aux2 *= x;
+    aux2 = aux; aux.montgomery_multiply(C);
+    aux2 += aux2; aux2.montgomery_multiply(x);
     aux += aux2; X -= aux;
 
-    aux = Y; Y *= x;
-    Y -= X; Y *= B;
-    aux *= y; aux *= C;
+    aux = Y; Y.montgomery_multiply(x);
+    Y -= X; Y.montgomery_multiply(B);
+    aux.montgomery_multiply(y); aux.montgomery_multiply(C);
     Y -= aux;
 
-    z *= C;
+    z.montgomery_multiply(C);
 
     x = X; y = Y;
 }
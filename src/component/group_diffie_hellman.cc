@@ -1,52 +1,247 @@
 // EPOS Group Diffie-Hellman Component Implementation
 
 #include <group_diffie_hellman.h>
-#include <utility/random.h>
 
 __BEGIN_SYS
 
-Group_Diffie_Hellman::Private_Key Group_Diffie_Hellman::generate_private_key(const Number& q) const
-{
-	Group_Diffie_Hellman::Private_Key generated;
-	do{
-		generated = Random::random() % q-1;
-	} while(generated == 0 || generated == 1 || gcd(generated, q-1) > 1);
-
-	return generated;
-}
-
-Group_Diffie_Hellman::Round_Key Group_Diffie_Hellman::insert_key(Group_Diffie_Hellman::Round_Key round_key) const
-{
-	db<Diffie_Hellman>(TRC) << "Diffie_Hellman::round_key(round=" << round_key << ",priv=" << _private_key << ")" << endl;
-
-	round_key = mod_exp(round_key, _private_key, _parameters.q());
-
-	db<Diffie_Hellman>(INF) << "Diffie_Hellman: round key = " << round_key << endl;
-
-	return round_key;
-}
-
-Group_Diffie_Hellman::Round_Key Group_Diffie_Hellman::insert_key() const
-{
-	db<Diffie_Hellman>(TRC) << "Diffie_Hellman::round_key(round=" << _parameters.base() << ",priv=" << _private_key << ")" << endl;
-
-	Round_Key round_key(_parameters.base());
-	round_key = mod_exp(round_key, _private_key, _parameters.q());	
-
-	db<Diffie_Hellman>(INF) << "Diffie_Hellman: round key = " << round_key << endl;
-
-	return round_key;
-}
-
-Group_Diffie_Hellman::Round_Key Group_Diffie_Hellman::remove_key(Group_Diffie_Hellman::Round_Key round_key) const
-{
-	db<Diffie_Hellman>(TRC) << "Diffie_Hellman::round_key(round=" << round_key << ",priv=" << _private_key << ")" << endl;
-
-	round_key = mod_exp(round_key, inverted_private_key(), _parameters.q());
-
-	db<Diffie_Hellman>(INF) << "Diffie_Hellman: round key = " << round_key << endl;
-
-	return round_key;
-}
+// Class attributes
+// Montgomery constants (_default_r2 and _default_n0) were generated offline for each default q
+// Toy group (q = 767410129): only meant for tests and single-frame TSTP round keys
+template<>
+const unsigned int Group_Diffie_Hellman_Common<32>::_default_base = 7;
+
+template<>
+const unsigned char Group_Diffie_Hellman_Common<32>::_default_q[KEY_SIZE] = { 0xd1, 0xbf, 0xbd, 0x2d };
+
+template<>
+const unsigned char Group_Diffie_Hellman_Common<32>::_default_r2[KEY_SIZE] = { 0x2a, 0x37, 0xb4, 0x28 };
+
+template<>
+const unsigned long long Group_Diffie_Hellman_Common<32>::_default_n0 = 0xed773c533fa306cfull;
+
+// Safe prime group: q = 2^128 - 21509 is the largest safe prime below 2^128 with q = 3 (mod 8), so 2 generates the whole group
+template<>
+const unsigned int Group_Diffie_Hellman_Common<128>::_default_base = 2;
+
+template<>
+const unsigned char Group_Diffie_Hellman_Common<128>::_default_q[KEY_SIZE] = { 0xfb, 0xab, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+
+template<>
+const unsigned char Group_Diffie_Hellman_Common<128>::_default_r2[KEY_SIZE] = { 0x19, 0x48, 0x93, 0x1b, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+template<>
+const unsigned long long Group_Diffie_Hellman_Common<128>::_default_n0 = 0xc6bd5028f15f58cdull;
+
+// Safe prime group: q = 2^256 - 188069 is the largest safe prime below 2^256 with q = 3 (mod 8), so 2 generates the whole group
+template<>
+const unsigned int Group_Diffie_Hellman_Common<256>::_default_base = 2;
+
+template<>
+const unsigned char Group_Diffie_Hellman_Common<256>::_default_q[KEY_SIZE] = {
+    0x5b, 0x21, 0xfd, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+template<>
+const unsigned char Group_Diffie_Hellman_Common<256>::_default_r2[KEY_SIZE] = {
+    0x59, 0x96, 0x36, 0x3c, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+};
+
+template<>
+const unsigned long long Group_Diffie_Hellman_Common<256>::_default_n0 = 0x71a1662e6fa1d92dull;
+
+// RFC 2409 1024-bit MODP Group (Oakley Group 2): q = 2^1024 - 2^960 - 1 + 2^64 * { [2^894 pi] + 129093 }
+template<>
+const unsigned int Group_Diffie_Hellman_Common<1024>::_default_base = 2;
+
+template<>
+const unsigned char Group_Diffie_Hellman_Common<1024>::_default_q[KEY_SIZE] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x81, 0x53, 0xe6, 0xec, 0x51, 0x66, 0x28, 0x49,
+    0xe6, 0x1f, 0x4b, 0x7c, 0x11, 0x24, 0x9f, 0xae, 0xa5, 0x9f, 0x89, 0x5a, 0xfb, 0x6b, 0x38, 0xee,
+    0xed, 0xb7, 0x06, 0xf4, 0xb6, 0x5c, 0xff, 0x0b, 0x6b, 0xed, 0x37, 0xa6, 0xe9, 0x42, 0x4c, 0xf4,
+    0xc6, 0x7e, 0x5e, 0x62, 0x76, 0xb5, 0x85, 0xe4, 0x45, 0xc2, 0x51, 0x6d, 0x6d, 0x35, 0xe1, 0x4f,
+    0x37, 0x14, 0x5f, 0xf2, 0x6d, 0x0a, 0x2b, 0x30, 0x1b, 0x43, 0x3a, 0xcd, 0xb3, 0x19, 0x95, 0xef,
+    0xdd, 0x04, 0x34, 0x8e, 0x79, 0x08, 0x4a, 0x51, 0x22, 0x9b, 0x13, 0x3b, 0xa6, 0xbe, 0x0b, 0x02,
+    0x74, 0xcc, 0x67, 0x8a, 0x08, 0x4e, 0x02, 0x29, 0xd1, 0x1c, 0xdc, 0x80, 0x8b, 0x62, 0xc6, 0xc4,
+    0x34, 0xc2, 0x68, 0x21, 0xa2, 0xda, 0x0f, 0xc9, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+template<>
+const unsigned char Group_Diffie_Hellman_Common<1024>::_default_r2[KEY_SIZE] = {
+    0x42, 0x1f, 0x03, 0x60, 0x55, 0xf0, 0xb8, 0x86, 0xb2, 0xe3, 0xb5, 0xc7, 0x90, 0x18, 0x2e, 0xc5,
+    0x2a, 0x17, 0x93, 0x18, 0x32, 0x72, 0xae, 0x7c, 0xe3, 0x89, 0x99, 0x96, 0xa4, 0x58, 0xda, 0x55,
+    0xb5, 0x09, 0x7f, 0x26, 0xfa, 0xfb, 0x69, 0x1f, 0x03, 0x08, 0xb8, 0x01, 0x0d, 0x5d, 0xe9, 0x64,
+    0x6d, 0x1c, 0xc5, 0x00, 0x84, 0x5e, 0x95, 0x0d, 0xf2, 0x37, 0xe6, 0x63, 0xa8, 0xae, 0x13, 0xa5,
+    0x8c, 0x15, 0xce, 0x74, 0x26, 0x15, 0xb0, 0x0c, 0x02, 0x5e, 0x65, 0xeb, 0xe4, 0x91, 0x27, 0xe1,
+    0xc7, 0x41, 0x00, 0x31, 0xe7, 0xd1, 0x92, 0x00, 0xc2, 0x80, 0x88, 0xc3, 0xec, 0x8f, 0x0d, 0x01,
+    0x8d, 0x64, 0xb7, 0xa6, 0x4c, 0xe3, 0x90, 0xb9, 0xfb, 0x16, 0x86, 0xe9, 0xcc, 0x67, 0x25, 0x43,
+    0x8d, 0x69, 0x74, 0x5a, 0xc7, 0x28, 0x45, 0x03, 0xad, 0x3e, 0x30, 0x3c, 0x82, 0xc2, 0x15, 0x64
+};
+
+template<>
+const unsigned long long Group_Diffie_Hellman_Common<1024>::_default_n0 = 0x0000000000000001ull;
+
+// RFC 3526 1536-bit MODP Group: q = 2^1536 - 2^1472 - 1 + 2^64 * { [2^1406 pi] + 741804 }
+template<>
+const unsigned int Group_Diffie_Hellman_Common<1536>::_default_base = 2;
+
+template<>
+const unsigned char Group_Diffie_Hellman_Common<1536>::_default_q[KEY_SIZE] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x27, 0x73, 0x23, 0xca, 0x08, 0x6c, 0x74, 0xf1,
+    0x04, 0x98, 0xbc, 0x4a, 0x4e, 0x35, 0x0c, 0x67, 0x6d, 0x96, 0x96, 0x70, 0x07, 0x29, 0xd5, 0x9e,
+    0xbb, 0x52, 0x85, 0x20, 0x56, 0xf3, 0x62, 0x1c, 0x96, 0xad, 0xa3, 0xdc, 0x23, 0x5d, 0x65, 0x83,
+    0x5f, 0xcf, 0x24, 0xfd, 0xa8, 0x3f, 0x16, 0x69, 0x9a, 0xd3, 0x55, 0x1c, 0x36, 0x48, 0xda, 0x98,
+    0x05, 0xbf, 0x63, 0xa1, 0xb8, 0x7c, 0x00, 0xc2, 0x3d, 0x5b, 0xe4, 0xec, 0x51, 0x66, 0x28, 0x49,
+    0xe6, 0x1f, 0x4b, 0x7c, 0x11, 0x24, 0x9f, 0xae, 0xa5, 0x9f, 0x89, 0x5a, 0xfb, 0x6b, 0x38, 0xee,
+    0xed, 0xb7, 0x06, 0xf4, 0xb6, 0x5c, 0xff, 0x0b, 0x6b, 0xed, 0x37, 0xa6, 0xe9, 0x42, 0x4c, 0xf4,
+    0xc6, 0x7e, 0x5e, 0x62, 0x76, 0xb5, 0x85, 0xe4, 0x45, 0xc2, 0x51, 0x6d, 0x6d, 0x35, 0xe1, 0x4f,
+    0x37, 0x14, 0x5f, 0xf2, 0x6d, 0x0a, 0x2b, 0x30, 0x1b, 0x43, 0x3a, 0xcd, 0xb3, 0x19, 0x95, 0xef,
+    0xdd, 0x04, 0x34, 0x8e, 0x79, 0x08, 0x4a, 0x51, 0x22, 0x9b, 0x13, 0x3b, 0xa6, 0xbe, 0x0b, 0x02,
+    0x74, 0xcc, 0x67, 0x8a, 0x08, 0x4e, 0x02, 0x29, 0xd1, 0x1c, 0xdc, 0x80, 0x8b, 0x62, 0xc6, 0xc4,
+    0x34, 0xc2, 0x68, 0x21, 0xa2, 0xda, 0x0f, 0xc9, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+template<>
+const unsigned char Group_Diffie_Hellman_Common<1536>::_default_r2[KEY_SIZE] = {
+    0xe0, 0x95, 0xc6, 0x32, 0x7d, 0xd2, 0x15, 0xf1, 0x73, 0x8c, 0x47, 0x67, 0x21, 0x3e, 0x0e, 0x8e,
+    0x45, 0xf2, 0x97, 0x83, 0xe1, 0x92, 0xab, 0xd0, 0x68, 0x9d, 0xd4, 0xbc, 0x5f, 0xee, 0x66, 0xf4,
+    0x18, 0xe0, 0x01, 0x3b, 0xb1, 0x31, 0x23, 0x8f, 0x62, 0xfb, 0xb5, 0x98, 0xac, 0xd2, 0x8c, 0x7e,
+    0x70, 0xf1, 0x58, 0x7a, 0xb4, 0x2b, 0x05, 0xb9, 0x39, 0x2d, 0x10, 0xdb, 0x50, 0xa7, 0x04, 0xb0,
+    0xeb, 0x1c, 0xae, 0x93, 0xff, 0x41, 0xa5, 0x04, 0x30, 0x41, 0x43, 0x8e, 0x62, 0x0a, 0xcd, 0x07,
+    0x96, 0xf7, 0xb9, 0x04, 0x7e, 0x9c, 0x72, 0x1c, 0x88, 0x7e, 0x6b, 0x19, 0x21, 0x61, 0xfe, 0xb8,
+    0x6b, 0xb7, 0x23, 0x02, 0x78, 0xbd, 0x1a, 0x8e, 0x23, 0xec, 0x6f, 0xd4, 0xe9, 0x96, 0xc2, 0x22,
+    0x1b, 0x52, 0x70, 0xb2, 0xea, 0x0e, 0x2a, 0xd6, 0x54, 0x3f, 0x05, 0xd4, 0x4e, 0x1a, 0x54, 0xdc,
+    0x02, 0x7f, 0x9b, 0x96, 0x64, 0x65, 0x05, 0xf8, 0x37, 0x7b, 0x7c, 0xa8, 0x47, 0x96, 0xe4, 0x0b,
+    0x60, 0x44, 0x98, 0x67, 0x48, 0x93, 0xb5, 0x57, 0x1f, 0xa5, 0x36, 0x9a, 0xfa, 0x30, 0x26, 0x10,
+    0xef, 0x56, 0x24, 0xcc, 0x02, 0xfa, 0xc3, 0xe9, 0xc7, 0xa1, 0x29, 0x79, 0x04, 0x41, 0x59, 0xae,
+    0xd2, 0xeb, 0xc1, 0x6c, 0x21, 0x9a, 0x9c, 0xee, 0x01, 0x1c, 0x54, 0x59, 0x72, 0x3c, 0xb3, 0xe3
+};
+
+template<>
+const unsigned long long Group_Diffie_Hellman_Common<1536>::_default_n0 = 0x0000000000000001ull;
+
+// RFC 3526 2048-bit MODP Group: q = 2^2048 - 2^1984 - 1 + 2^64 * { [2^1918 pi] + 124476 }
+template<>
+const unsigned int Group_Diffie_Hellman_Common<2048>::_default_base = 2;
+
+template<>
+const unsigned char Group_Diffie_Hellman_Common<2048>::_default_q[KEY_SIZE] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x68, 0xaa, 0xac, 0x8a, 0x5a, 0x8e, 0x72, 0x15,
+    0x10, 0x05, 0xfa, 0x98, 0x18, 0x26, 0xd2, 0x15, 0xe5, 0x6a, 0x95, 0xea, 0x7c, 0x49, 0x95, 0x39,
+    0x18, 0x17, 0x58, 0x95, 0xf6, 0xcb, 0x2b, 0xde, 0xc9, 0x52, 0x4c, 0x6f, 0xf0, 0x5d, 0xc5, 0xb5,
+    0x8f, 0xa2, 0x07, 0xec, 0xa2, 0x83, 0x27, 0x9b, 0x03, 0x86, 0x0e, 0x18, 0x2c, 0x77, 0x9e, 0xe3,
+    0x3b, 0xce, 0x36, 0x2e, 0x46, 0x5e, 0x90, 0x32, 0x7c, 0x21, 0x18, 0xca, 0x08, 0x6c, 0x74, 0xf1,
+    0x04, 0x98, 0xbc, 0x4a, 0x4e, 0x35, 0x0c, 0x67, 0x6d, 0x96, 0x96, 0x70, 0x07, 0x29, 0xd5, 0x9e,
+    0xbb, 0x52, 0x85, 0x20, 0x56, 0xf3, 0x62, 0x1c, 0x96, 0xad, 0xa3, 0xdc, 0x23, 0x5d, 0x65, 0x83,
+    0x5f, 0xcf, 0x24, 0xfd, 0xa8, 0x3f, 0x16, 0x69, 0x9a, 0xd3, 0x55, 0x1c, 0x36, 0x48, 0xda, 0x98,
+    0x05, 0xbf, 0x63, 0xa1, 0xb8, 0x7c, 0x00, 0xc2, 0x3d, 0x5b, 0xe4, 0xec, 0x51, 0x66, 0x28, 0x49,
+    0xe6, 0x1f, 0x4b, 0x7c, 0x11, 0x24, 0x9f, 0xae, 0xa5, 0x9f, 0x89, 0x5a, 0xfb, 0x6b, 0x38, 0xee,
+    0xed, 0xb7, 0x06, 0xf4, 0xb6, 0x5c, 0xff, 0x0b, 0x6b, 0xed, 0x37, 0xa6, 0xe9, 0x42, 0x4c, 0xf4,
+    0xc6, 0x7e, 0x5e, 0x62, 0x76, 0xb5, 0x85, 0xe4, 0x45, 0xc2, 0x51, 0x6d, 0x6d, 0x35, 0xe1, 0x4f,
+    0x37, 0x14, 0x5f, 0xf2, 0x6d, 0x0a, 0x2b, 0x30, 0x1b, 0x43, 0x3a, 0xcd, 0xb3, 0x19, 0x95, 0xef,
+    0xdd, 0x04, 0x34, 0x8e, 0x79, 0x08, 0x4a, 0x51, 0x22, 0x9b, 0x13, 0x3b, 0xa6, 0xbe, 0x0b, 0x02,
+    0x74, 0xcc, 0x67, 0x8a, 0x08, 0x4e, 0x02, 0x29, 0xd1, 0x1c, 0xdc, 0x80, 0x8b, 0x62, 0xc6, 0xc4,
+    0x34, 0xc2, 0x68, 0x21, 0xa2, 0xda, 0x0f, 0xc9, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+template<>
+const unsigned char Group_Diffie_Hellman_Common<2048>::_default_r2[KEY_SIZE] = {
+    0x64, 0xb6, 0x5f, 0x12, 0xce, 0x22, 0x71, 0x47, 0x13, 0xd3, 0x38, 0x9b, 0xfb, 0x48, 0x35, 0xb0,
+    0xc1, 0x12, 0xd4, 0x6f, 0xff, 0x53, 0x21, 0x4c, 0xc6, 0x9b, 0x3f, 0x87, 0x50, 0x2b, 0x09, 0x2a,
+    0xf9, 0xf5, 0xb7, 0xfc, 0x29, 0x16, 0xc7, 0xbb, 0xe7, 0x84, 0xbd, 0x36, 0xe1, 0x06, 0xec, 0x4b,
+    0xb1, 0x0c, 0x02, 0x6b, 0x5a, 0x72, 0xba, 0x27, 0xeb, 0x9e, 0x93, 0xed, 0x26, 0x54, 0x11, 0xf8,
+    0xd9, 0x30, 0x0e, 0x8a, 0x87, 0xb1, 0xc1, 0x4b, 0xff, 0x33, 0x86, 0x25, 0x0e, 0x82, 0x20, 0x56,
+    0x71, 0x30, 0x5a, 0x78, 0xab, 0xd6, 0x4e, 0x07, 0x61, 0xcb, 0xf1, 0x81, 0x5f, 0x10, 0x28, 0xf2,
+    0x7f, 0x6f, 0x2e, 0x4e, 0x6f, 0x43, 0x0e, 0x57, 0xd9, 0x0b, 0x45, 0xd7, 0xf7, 0x2f, 0xa5, 0x5c,
+    0x7e, 0x0a, 0xf1, 0x75, 0xd2, 0x72, 0x22, 0x55, 0x78, 0x79, 0x9c, 0x73, 0x25, 0x79, 0x2b, 0xac,
+    0xd0, 0x54, 0x5b, 0x32, 0x57, 0x82, 0xf8, 0xa2, 0xd5, 0x2b, 0xd7, 0xe8, 0x9d, 0x1c, 0x82, 0xbc,
+    0x86, 0x29, 0x6d, 0x86, 0xb3, 0x42, 0xd4, 0xdb, 0xce, 0xb2, 0xc4, 0x70, 0x1b, 0x95, 0x78, 0x94,
+    0x76, 0x0c, 0x91, 0x94, 0xb3, 0x8f, 0x99, 0x5d, 0x67, 0x08, 0x30, 0x7e, 0x93, 0xb2, 0x73, 0xf2,
+    0x92, 0x9f, 0x56, 0x38, 0xbe, 0x6b, 0x10, 0x8c, 0xc5, 0x92, 0xe9, 0x14, 0xcb, 0x92, 0x3c, 0xf8,
+    0xdd, 0x80, 0x68, 0xed, 0x7e, 0x6e, 0x5d, 0xd8, 0xdf, 0xa1, 0x06, 0xbe, 0x6f, 0x27, 0x5b, 0xeb,
+    0x05, 0xe1, 0x11, 0xfa, 0x90, 0x20, 0x49, 0x2a, 0xbe, 0x00, 0xea, 0x19, 0x6d, 0xd9, 0xbd, 0x63,
+    0xab, 0x98, 0x16, 0x0a, 0x97, 0x82, 0x23, 0x27, 0x74, 0xc9, 0x40, 0x92, 0x6c, 0x68, 0x3a, 0x8a,
+    0x00, 0x30, 0x61, 0x66, 0x03, 0x57, 0xd8, 0x3e, 0x97, 0x31, 0x8b, 0x62, 0x33, 0x7a, 0xd3, 0x0c
+};
+
+template<>
+const unsigned long long Group_Diffie_Hellman_Common<2048>::_default_n0 = 0x0000000000000001ull;
+
+// RFC 3526 3072-bit MODP Group: q = 2^3072 - 2^3008 - 1 + 2^64 * { [2^2942 pi] + 1690314 }
+template<>
+const unsigned int Group_Diffie_Hellman_Common<3072>::_default_base = 2;
+
+template<>
+const unsigned char Group_Diffie_Hellman_Common<3072>::_default_q[KEY_SIZE] = {
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xca, 0xd2, 0x3a, 0xa9, 0x20, 0xd1, 0x82, 0x4b,
+    0x8e, 0x10, 0xfd, 0xe0, 0xfc, 0x5b, 0xdb, 0x43, 0x31, 0xab, 0xe5, 0x74, 0xa0, 0x4f, 0xe2, 0x08,
+    0xe2, 0x46, 0xd9, 0xba, 0xc0, 0x88, 0x09, 0x77, 0x6c, 0x5d, 0x61, 0x7a, 0x57, 0x17, 0xe1, 0xbb,
+    0x0c, 0x20, 0x7b, 0x17, 0x18, 0x2b, 0x1f, 0x52, 0x64, 0x6a, 0xc8, 0x3e, 0x73, 0x02, 0x76, 0xd8,
+    0x64, 0x08, 0x8a, 0xd9, 0x06, 0xfa, 0x2f, 0xf1, 0x6b, 0xee, 0xd2, 0x1a, 0x26, 0xd2, 0xe3, 0xce,
+    0x9d, 0x61, 0x25, 0x4a, 0xe0, 0x94, 0x8c, 0x1e, 0xd7, 0x33, 0x09, 0xdb, 0x8c, 0xae, 0xf5, 0xab,
+    0xc7, 0xe4, 0xe1, 0xa6, 0x85, 0x0f, 0x97, 0xb3, 0x7d, 0x0c, 0x06, 0x5d, 0x57, 0x71, 0xea, 0x8a,
+    0x0a, 0xef, 0xdb, 0x58, 0x04, 0x85, 0xfb, 0xec, 0x64, 0xba, 0x1c, 0xdf, 0xab, 0x21, 0x55, 0xa8,
+    0x33, 0x7a, 0x50, 0x04, 0x0d, 0x17, 0x33, 0xad, 0x2d, 0xc4, 0xaa, 0x8a, 0x5a, 0x8e, 0x72, 0x15,
+    0x10, 0x05, 0xfa, 0x98, 0x18, 0x26, 0xd2, 0x15, 0xe5, 0x6a, 0x95, 0xea, 0x7c, 0x49, 0x95, 0x39,
+    0x18, 0x17, 0x58, 0x95, 0xf6, 0xcb, 0x2b, 0xde, 0xc9, 0x52, 0x4c, 0x6f, 0xf0, 0x5d, 0xc5, 0xb5,
+    0x8f, 0xa2, 0x07, 0xec, 0xa2, 0x83, 0x27, 0x9b, 0x03, 0x86, 0x0e, 0x18, 0x2c, 0x77, 0x9e, 0xe3,
+    0x3b, 0xce, 0x36, 0x2e, 0x46, 0x5e, 0x90, 0x32, 0x7c, 0x21, 0x18, 0xca, 0x08, 0x6c, 0x74, 0xf1,
+    0x04, 0x98, 0xbc, 0x4a, 0x4e, 0x35, 0x0c, 0x67, 0x6d, 0x96, 0x96, 0x70, 0x07, 0x29, 0xd5, 0x9e,
+    0xbb, 0x52, 0x85, 0x20, 0x56, 0xf3, 0x62, 0x1c, 0x96, 0xad, 0xa3, 0xdc, 0x23, 0x5d, 0x65, 0x83,
+    0x5f, 0xcf, 0x24, 0xfd, 0xa8, 0x3f, 0x16, 0x69, 0x9a, 0xd3, 0x55, 0x1c, 0x36, 0x48, 0xda, 0x98,
+    0x05, 0xbf, 0x63, 0xa1, 0xb8, 0x7c, 0x00, 0xc2, 0x3d, 0x5b, 0xe4, 0xec, 0x51, 0x66, 0x28, 0x49,
+    0xe6, 0x1f, 0x4b, 0x7c, 0x11, 0x24, 0x9f, 0xae, 0xa5, 0x9f, 0x89, 0x5a, 0xfb, 0x6b, 0x38, 0xee,
+    0xed, 0xb7, 0x06, 0xf4, 0xb6, 0x5c, 0xff, 0x0b, 0x6b, 0xed, 0x37, 0xa6, 0xe9, 0x42, 0x4c, 0xf4,
+    0xc6, 0x7e, 0x5e, 0x62, 0x76, 0xb5, 0x85, 0xe4, 0x45, 0xc2, 0x51, 0x6d, 0x6d, 0x35, 0xe1, 0x4f,
+    0x37, 0x14, 0x5f, 0xf2, 0x6d, 0x0a, 0x2b, 0x30, 0x1b, 0x43, 0x3a, 0xcd, 0xb3, 0x19, 0x95, 0xef,
+    0xdd, 0x04, 0x34, 0x8e, 0x79, 0x08, 0x4a, 0x51, 0x22, 0x9b, 0x13, 0x3b, 0xa6, 0xbe, 0x0b, 0x02,
+    0x74, 0xcc, 0x67, 0x8a, 0x08, 0x4e, 0x02, 0x29, 0xd1, 0x1c, 0xdc, 0x80, 0x8b, 0x62, 0xc6, 0xc4,
+    0x34, 0xc2, 0x68, 0x21, 0xa2, 0xda, 0x0f, 0xc9, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+template<>
+const unsigned char Group_Diffie_Hellman_Common<3072>::_default_r2[KEY_SIZE] = {
+    0xcd, 0x41, 0xd2, 0x38, 0x91, 0xca, 0x97, 0x26, 0x38, 0xf1, 0xe7, 0x60, 0x69, 0xf0, 0x87, 0x35,
+    0x66, 0xdb, 0xc1, 0xe5, 0x20, 0xb9, 0x30, 0x4f, 0x77, 0xa5, 0x5b, 0xb1, 0x15, 0x32, 0x82, 0x95,
+    0x96, 0x4d, 0x89, 0x64, 0xcb, 0xaa, 0x35, 0x43, 0xa3, 0xd6, 0x6e, 0x3c, 0x02, 0x84, 0x12, 0xae,
+    0xab, 0x06, 0x84, 0xfa, 0xa5, 0x87, 0x11, 0xfc, 0xfa, 0x7f, 0xb1, 0x15, 0x9a, 0xab, 0x2a, 0x68,
+    0xd7, 0x35, 0xe3, 0x26, 0xcf, 0x64, 0x2b, 0xbc, 0x6a, 0xb7, 0xb0, 0xab, 0x91, 0x13, 0xa6, 0x8a,
+    0xb2, 0x52, 0x1a, 0xe4, 0x71, 0x25, 0xf2, 0x1e, 0x47, 0xd1, 0x93, 0xa9, 0x5a, 0x07, 0x93, 0x1d,
+    0xda, 0xed, 0x7d, 0xa7, 0x7f, 0x18, 0xa5, 0xfe, 0xc6, 0x61, 0x35, 0x44, 0xb5, 0xd4, 0x80, 0xaf,
+    0x59, 0x28, 0xdf, 0x83, 0x4b, 0x42, 0x86, 0xb1, 0x7f, 0xbc, 0x59, 0x8a, 0x18, 0xfc, 0xae, 0x1c,
+    0xc8, 0xf0, 0x18, 0x1d, 0x27, 0x01, 0x9d, 0x1b, 0xf4, 0xb3, 0xc0, 0xc3, 0x9d, 0xf2, 0xfe, 0x3e,
+    0x0c, 0x8c, 0x10, 0x08, 0xc6, 0x83, 0x54, 0x78, 0x53, 0x8b, 0xe8, 0x56, 0x82, 0x76, 0x12, 0x4f,
+    0xdd, 0xfc, 0xd6, 0x38, 0xd5, 0x61, 0xd9, 0xbf, 0x08, 0x42, 0x02, 0x78, 0xf0, 0x05, 0x1a, 0xb4,
+    0xfb, 0x06, 0x37, 0x56, 0x59, 0x8d, 0xcc, 0x19, 0x87, 0x49, 0xcc, 0x6e, 0xd8, 0x95, 0x77, 0x5a,
+    0xeb, 0x12, 0x9f, 0x43, 0xf4, 0x8b, 0x67, 0x9a, 0x9c, 0xf9, 0x43, 0xc0, 0x2e, 0x50, 0xda, 0x7c,
+    0x74, 0x7f, 0xe3, 0x61, 0x3d, 0xa3, 0x72, 0x06, 0xaf, 0x02, 0xc8, 0xef, 0x3e, 0x88, 0xc2, 0x19,
+    0x6f, 0x9c, 0x0d, 0x67, 0x9e, 0x48, 0xed, 0x7d, 0x90, 0x8e, 0x4b, 0x2c, 0x03, 0x01, 0x3d, 0xa7,
+    0x34, 0x51, 0x96, 0xd5, 0x34, 0xbd, 0x6c, 0x8c, 0x83, 0x0a, 0x5b, 0xd8, 0x47, 0xc7, 0xa5, 0x77,
+    0x68, 0x75, 0xfd, 0x16, 0x9e, 0x09, 0x9d, 0x10, 0x9e, 0x5e, 0x8d, 0xbc, 0x36, 0xf7, 0xda, 0xa5,
+    0x95, 0xe4, 0xb7, 0x24, 0xab, 0xd0, 0x39, 0x71, 0xd5, 0x84, 0xa1, 0x5d, 0x70, 0x9d, 0xcd, 0x49,
+    0x1c, 0x2c, 0x1f, 0x57, 0x40, 0xcb, 0x76, 0x22, 0x86, 0x60, 0x39, 0xdc, 0x5c, 0xc4, 0x0e, 0xaf,
+    0x33, 0xdd, 0x7f, 0xc2, 0x05, 0xda, 0x05, 0xaa, 0xdc, 0x7e, 0xdb, 0x67, 0xc1, 0xd4, 0x75, 0x98,
+    0x3f, 0x54, 0xbf, 0x9f, 0x00, 0x69, 0xaa, 0x5c, 0x72, 0xe7, 0x8d, 0xf2, 0x36, 0x23, 0x02, 0xfa,
+    0x54, 0xee, 0x8b, 0x64, 0x10, 0xcd, 0xe1, 0xfa, 0x75, 0x5c, 0x69, 0x69, 0xfe, 0x79, 0xd4, 0x2a,
+    0x6c, 0xf9, 0x42, 0x55, 0x7c, 0x5a, 0x89, 0x84, 0x0f, 0x9e, 0x66, 0xe0, 0xe3, 0xe8, 0x32, 0xa3,
+    0x95, 0x02, 0xad, 0x31, 0xe4, 0xe4, 0xc4, 0x44, 0xda, 0x35, 0xdf, 0x51, 0xfb, 0xb4, 0xc8, 0x5a
+};
+
+template<>
+const unsigned long long Group_Diffie_Hellman_Common<3072>::_default_n0 = 0x0000000000000001ull;
+
+// secp128r1 base point (the same as Diffie_Hellman's) and its prime order n = FFFFFFFE0000000075A30D1B9038A115
+const unsigned char Elliptic_Curve_Group_Diffie_Hellman::_default_base_x[sizeof(Number)] = {
+    0x86, 0x5b, 0x2c, 0xa5, 0x7c, 0x60, 0x28, 0x0c, 0x2d, 0x9b, 0x89, 0x8b, 0x52, 0xf7, 0x1f, 0x16
+};
+
+const unsigned char Elliptic_Curve_Group_Diffie_Hellman::_default_base_y[sizeof(Number)] = {
+    0x83, 0x7a, 0xed, 0xdd, 0x92, 0xa2, 0x2d, 0xc0, 0x13, 0xeb, 0xaf, 0x5b, 0x39, 0xc8, 0x5a, 0xcf
+};
+
+const unsigned char Elliptic_Curve_Group_Diffie_Hellman::_default_order[sizeof(Number)] = {
+    0x15, 0xa1, 0x38, 0x90, 0x1b, 0x0d, 0xa3, 0x75, 0x00, 0x00, 0x00, 0x00, 0xfe, 0xff, 0xff, 0xff
+};
 
 __END_SYS
@@ -1,4 +1,6 @@
-// EPOS Diffie-Hellman Component Test Program
+// EPOS Group Diffie-Hellman Component Test Program
+// Groups are kept within what an eMote3 holds (3 KB of stack, objects on the heap); tools/eposgdhsim runs the
+// chain for the 1024- to 3072-bit groups on the host (e.g. eposgdhsim -b 2048 -n 4) and checks their constants
 
 #include <group_diffie_hellman.h>
 #include <utility/ostream.h>
@@ -9,75 +11,74 @@ using namespace EPOS;
 OStream cout;
 
 static const unsigned int ITERATIONS = 50;
+static const unsigned int MODP_ITERATIONS = 2;
 
-int main()
+template<unsigned int BITS, unsigned int TEETH>
+unsigned int test(unsigned int iterations)
 {
-    unsigned int seed = Random::random();
-    Random::seed(seed);
+    typedef Group_Diffie_Hellman<BITS, Group_Diffie_Hellman_Common<BITS>::DEFAULT_WINDOW, TEETH> GDH;
+
+    GDH::precompute(); // first's insert_key() goes through the comb, and the others' round keys check it
+
+    cout << endl;
+    cout << "Group_Diffie_Hellman<" << BITS << ", " << Group_Diffie_Hellman_Common<BITS>::DEFAULT_WINDOW << ", " << TEETH << ">" << endl;
+    cout << "sizeof(Group_Diffie_Hellman) = " << sizeof(GDH) << endl;
+    cout << "Group_Diffie_Hellman::TABLE_SIZE = " << GDH::TABLE_SIZE << endl;
+    cout << "sizeof(Group_Diffie_Hellman::Round_Key) = " << sizeof(typename GDH::Round_Key) << endl;
+    cout << "sizeof(Group_Diffie_Hellman::Private_Key) = " << sizeof(typename GDH::Private_Key) << endl;
+    cout << "Iterations = " << iterations << endl;
 
-    cout << "EPOS Group Diffie-Hellman Test" << endl;
-    cout << "Configuration: " << endl;
-    // cout << "Group_Diffie_Hellman::SECRET_SIZE = " << Group_Diffie_Hellman::SECRET_SIZE << endl;
-    // cout << "Group_Diffie_Hellman::PUBLIC_KEY_SIZE = " << Group_Diffie_Hellman::PUBLIC_KEY_SIZE << endl;
-    cout << "sizeof(Group_Diffie_Hellman) = " << sizeof(Group_Diffie_Hellman) << endl;
-    cout << "sizeof(Group_Diffie_Hellman::Public_Key) = " << sizeof(Group_Diffie_Hellman::Round_Key) << endl;
-    cout << "sizeof(Group_Diffie_Hellman::Private_Key) = " << sizeof(Group_Diffie_Hellman::Private_Key) << endl;
-    cout << "Random seed = " << seed << endl;
-    cout << "Iterations = " << ITERATIONS << endl;
-    
     unsigned int tests_failed = 0;
-    
-    for(unsigned int it = 0; it < ITERATIONS; it++) {
+
+    for(unsigned int it = 0; it < iterations; it++) {
         cout << endl;
         cout << "Iteration " << it << endl;
-    
-		Group_Diffie_Hellman gateway;
-		Group_Diffie_Hellman first;
-        Group_Diffie_Hellman intermediate;
-		Group_Diffie_Hellman last;
-    
-        Group_Diffie_Hellman::Round_Key first_round = first.insert_key(); //mod exp of the public key base to the power of its private key
-		//first send its round key to intermediate
-		Group_Diffie_Hellman::Round_Key intermediate_round = intermediate.insert_key(first_round); //mod exp of the number received to the power of its private key
-		//intermediate sends its round key to last
-		Group_Diffie_Hellman::Round_Key last_round = last.insert_key(intermediate_round);
-		//intermediate sends its round key to all the nodes, including the gateway
-		auto last_removed = intermediate_round; //the last node doesn't have to remove its private key because it already receives it ready from the intermediate node
-		//intermediate sends the previous round key to the gateway
-		Group_Diffie_Hellman::Round_Key gateway_final = gateway.insert_key(last_round);
-		//first and intermediate remove their private keys from the round key
-		Group_Diffie_Hellman::Round_Key first_removed = first.remove_key(last_round);
-		Group_Diffie_Hellman::Round_Key intermediate_removed = intermediate.remove_key(last_round);
-		//first and intermediate send them to the gateway
-		Group_Diffie_Hellman::Round_Key first_missing_own = gateway.insert_key(first_removed);
-		Group_Diffie_Hellman::Round_Key intermediate_missing_own = gateway.insert_key(intermediate_removed);
-		Group_Diffie_Hellman::Round_Key last_missing_own = gateway.insert_key(last_removed);
-		//the gateway sends the key without each node's private key to each of them so they can do the last exponentiation
-		Group_Diffie_Hellman::Round_Key first_final = first.insert_key(first_missing_own);
-		Group_Diffie_Hellman::Round_Key intermediate_final = intermediate.insert_key(intermediate_missing_own);
-		Group_Diffie_Hellman::Round_Key last_final = last.insert_key(last_missing_own);
-    
-        cout << "first round " << first_round << endl;
-        cout << "intermediate round " << intermediate_round << endl;
-        cout << "last round " << last_round << endl;
-    
-        cout << "first removed " << first_removed << endl;
-        cout << "intermediate removed " << intermediate_removed << endl;
-    
-        cout << "first missing_own " << first_missing_own << endl;
-        cout << "intermediate missing_own " << intermediate_missing_own << endl;
-        cout << "last missing_own " << last_missing_own << endl;
-    
-        cout << "first final " << first_final << endl;
-        cout << "intermediate final " << intermediate_final << endl;
-        cout << "last final " << last_final << endl;
-        cout << "gateway final " << gateway_final << endl;
-    
-        bool ok = gateway_final == first_final && first_final == intermediate_final && intermediate_final == last_final;
-        // bool ok1 = gateway_final.x == first_final.x && gateway_final.y == first_final.y && gateway_final.z == first_final.z;
-        // bool ok2 = first_final.x == intermediate_final.x && first_final.y == intermediate_final.y && first_final.z == intermediate_final.z;
-        // bool ok3 = intermediate_final.x == last_final.x && intermediate_final.y == last_final.y && intermediate_final.z == last_final.z;
-        // bool ok = ok1 && ok2 && ok3;
+
+        GDH * gateway = new GDH;
+        GDH * first = new GDH;
+        GDH * intermediate = new GDH;
+        GDH * last = new GDH;
+
+        typename GDH::Round_Key first_round = first->insert_key(); //mod exp of the public key base to the power of its private key
+        //first send its round key to intermediate
+        typename GDH::Round_Key intermediate_round = intermediate->insert_key(first_round); //mod exp of the number received to the power of its private key
+        //intermediate sends its round key to last
+        typename GDH::Round_Key last_round = last->insert_key(intermediate_round);
+        //intermediate sends its round key to all the nodes, including the gateway
+        typename GDH::Round_Key last_removed = intermediate_round; //the last node doesn't have to remove its private key because it already receives it ready from the intermediate node
+        //intermediate sends the previous round key to the gateway
+        typename GDH::Round_Key gateway_final = gateway->insert_key(last_round);
+        //first and intermediate remove their private keys from the round key
+        typename GDH::Round_Key first_removed = first->remove_key(last_round);
+        typename GDH::Round_Key intermediate_removed = intermediate->remove_key(last_round);
+        //first and intermediate send them to the gateway
+        typename GDH::Round_Key first_missing_own = gateway->insert_key(first_removed);
+        typename GDH::Round_Key intermediate_missing_own = gateway->insert_key(intermediate_removed);
+        typename GDH::Round_Key last_missing_own = gateway->insert_key(last_removed);
+        //the gateway may also process all of them at once
+        typename GDH::Round_Key batch[3] = { first_removed, intermediate_removed, last_removed };
+        gateway->insert_key(batch, 3);
+        bool batch_ok = batch[0] == first_missing_own && batch[1] == intermediate_missing_own && batch[2] == last_missing_own;
+        //the gateway sends the key without each node's private key to each of them so they can do the last exponentiation
+        typename GDH::Round_Key first_final = first->insert_key(first_missing_own);
+        typename GDH::Round_Key intermediate_final = intermediate->insert_key(intermediate_missing_own);
+        typename GDH::Round_Key last_final = last->insert_key(last_missing_own);
+
+        //to evict last, the gateway refreshes its share and re-exponentiates the partial keys it kept, except last's
+        gateway->rotate_key();
+        typename GDH::Round_Key gateway_left = gateway->insert_key(last_round);
+        typename GDH::Round_Key first_left = first->insert_key(gateway->insert_key(first_removed));
+        typename GDH::Round_Key intermediate_left = intermediate->insert_key(gateway->insert_key(intermediate_removed));
+        bool leave_ok = !(gateway_left == gateway_final) && gateway_left == first_left && first_left == intermediate_left;
+
+        //a member may also take a key pair computed ahead of time, whose first round key comes for free
+        typename GDH::Key_Pair pair = gateway->key_pair();
+        GDH * pooled = new GDH(gateway->parameters(), pair);
+        typename GDH::Round_Key pooled_round = pooled->insert_key();
+        bool pool_ok = pooled_round == pair.round_key && pooled->insert_key(gateway->parameters().base()) == pooled_round
+            && pooled->remove_key(pooled->insert_key(last_round)) == last_round;
+
+        bool ok = batch_ok && leave_ok && pool_ok && gateway_final == first_final && first_final == intermediate_final && intermediate_final == last_final;
         if(ok) {
             cout << "Shared key = " << gateway_final << endl;
             cout << "OK! The key shared among all members of the group is the same" << endl;
@@ -87,12 +88,273 @@ int main()
             cout << "Intermediate's shared key: " << intermediate_final << endl;
             cout << "Last's shared key: " << last_final << endl;
             cout << "Gateway's shared key: " << gateway_final << endl;
+            cout << "Gateway's batch keys: " << (batch_ok ? "match" : "do not match") << endl;
+            cout << "Keys after leave: " << (leave_ok ? "match" : "do not match") << endl;
+            cout << "Pooled key pair: " << (pool_ok ? "matches" : "does not match") << endl;
             cout << "ERROR! Shared keys do not match!" << endl;
         }
-    
+
+        delete pooled;
+        delete last;
+        delete intermediate;
+        delete first;
+        delete gateway;
+
         tests_failed += !ok;
     }
-    
+
+    return tests_failed;
+}
+
+// The same chain as test(), with round keys that are curve points
+unsigned int elliptic_curve_test(unsigned int iterations)
+{
+    typedef Elliptic_Curve_Group_Diffie_Hellman GDH;
+
+    cout << endl;
+    cout << "Elliptic_Curve_Group_Diffie_Hellman" << endl;
+    cout << "sizeof(Elliptic_Curve_Group_Diffie_Hellman) = " << sizeof(GDH) << endl;
+    cout << "sizeof(Elliptic_Curve_Group_Diffie_Hellman::Round_Key) = " << sizeof(GDH::Round_Key) << endl;
+    cout << "Iterations = " << iterations << endl;
+
+    unsigned int tests_failed = 0;
+
+    for(unsigned int it = 0; it < iterations; it++) {
+        GDH * gateway = new GDH;
+        GDH * first = new GDH;
+        GDH * intermediate = new GDH;
+        GDH * last = new GDH(gateway->parameters(), gateway->key_pair());
+
+        GDH::Round_Key intermediate_round = intermediate->insert_key(first->insert_key());
+        GDH::Round_Key last_round = last->insert_key(intermediate_round);
+        GDH::Round_Key gateway_final = gateway->insert_key(last_round);
+        GDH::Round_Key partial[3] = { first->remove_key(last_round), intermediate->remove_key(last_round), intermediate_round };
+        gateway->insert_key(partial, 3);
+
+        bool ok = (first->insert_key(partial[0]) == gateway_final) && (intermediate->insert_key(partial[1]) == gateway_final)
+            && (last->insert_key(partial[2]) == gateway_final) && (last->insert_key() == last->insert_key(gateway->parameters().base()));
+        if(ok)
+            cout << "OK! Shared key = " << gateway_final << endl;
+        else
+            cout << "ERROR! Shared keys do not match!" << endl;
+
+        delete last;
+        delete intermediate;
+        delete first;
+        delete gateway;
+
+        tests_failed += !ok;
+    }
+
+    return tests_failed;
+}
+
+// The constant-time Montgomery ladder (WINDOW = 0) must agree with the sliding window for the same keys
+template<unsigned int BITS>
+unsigned int ladder_test(unsigned int iterations)
+{
+    typedef Group_Diffie_Hellman<BITS> Window;
+    typedef Group_Diffie_Hellman<BITS, 0> Ladder;
+
+    cout << endl;
+    cout << "Group_Diffie_Hellman<" << BITS << ", 0> (Montgomery ladder)" << endl;
+    cout << "Iterations = " << iterations << endl;
+
+    unsigned int tests_failed = 0;
+
+    for(unsigned int it = 0; it < iterations; it++) {
+        Window * window = new Window;
+        typename Window::Key_Pair pair = window->key_pair();
+        typename Ladder::Key_Pair same = { pair.private_key, pair.inverse, pair.round_key };
+        window->rotate_key(pair);
+        Ladder * ladder = new Ladder(window->parameters(), same);
+        Ladder * fresh = new Ladder;
+
+        typename Window::Round_Key round = fresh->insert_key();
+        typename Window::Round_Key batch[2] = { round, window->parameters().base() };
+        ladder->insert_key(batch, 2);
+
+        bool ok = (ladder->insert_key(window->parameters().base()) == pair.round_key) && (ladder->insert_key(round) == window->insert_key(round)) && (ladder->remove_key(round) == window->remove_key(round))
+            && (ladder->remove_key(ladder->insert_key(round)) == round) && (batch[0] == window->insert_key(round)) && (batch[1] == pair.round_key);
+        if(ok)
+            cout << "OK! Round key = " << ladder->insert_key(round) << endl;
+        else
+            cout << "ERROR! The ladder and the sliding window do not match!" << endl;
+
+        delete fresh;
+        delete ladder;
+        delete window;
+
+        tests_failed += !ok;
+    }
+
+    return tests_failed;
+}
+
+// Checks the precomputed Montgomery constants of the default parameters against the ones computed at runtime
+template<unsigned int BITS>
+class Montgomery_Test: public Group_Diffie_Hellman<BITS>
+{
+    typedef Group_Diffie_Hellman<BITS> Base;
+    typedef typename Base::Number Number;
+    typedef typename Base::Digit Digit;
+
+public:
+    static unsigned int test() {
+        Number q = Base::default_parameters().q();
+        Number r2, computed_r2;
+        Digit n0, computed_n0;
+        Base::montgomery_setup(r2, n0, q);
+        Base::montgomery_compute(computed_r2, computed_n0, q);
+
+        bool ok = (r2 == computed_r2) && (n0 == computed_n0);
+        cout << endl;
+        cout << "Montgomery constants of the default " << BITS << "-bit group: " << (ok ? "OK!" : "ERROR! They do not match!") << endl;
+        return !ok;
+    }
+};
+
+// Delivers the blinded key of block(level) of member i to every member of its sibling block
+template<typename TGDH>
+void tree_announce(TGDH * members[], unsigned int n, unsigned int i, unsigned int level)
+{
+    typename TGDH::Round_Key blinded = members[i]->blinded_key(level);
+    for(unsigned int j = 0; j < n; j++)
+        if(members[j]->block(level) == members[i]->sibling(level))
+            members[j]->sibling_key(level, blinded);
+}
+
+template<typename TGDH>
+bool tree_agree(TGDH * members[], unsigned int n)
+{
+    for(unsigned int i = 0; i < n; i++)
+        if(!members[i]->ready() || !(members[i]->key() == members[0]->key()))
+            return false;
+    return true;
+}
+
+template<unsigned int BITS, unsigned int DEPTH>
+unsigned int tree_test(unsigned int n)
+{
+    typedef Tree_Group_Diffie_Hellman<BITS, DEPTH> TGDH;
+
+    cout << endl;
+    cout << "Tree_Group_Diffie_Hellman<" << BITS << ", " << DEPTH << "> with " << n << " members" << endl;
+    cout << "sizeof(Tree_Group_Diffie_Hellman) = " << sizeof(TGDH) << endl;
+
+    TGDH * members[TGDH::MAX_MEMBERS];
+    for(unsigned int i = 0; i < n; i++)
+        members[i] = new TGDH(TGDH::default_parameters(), i, n);
+
+    // Level by level, each sponsor announces its block's blinded key to the sibling block
+    unsigned int rounds = 0;
+    for(unsigned int level = 0; level < members[0]->depth(); level++, rounds++)
+        for(unsigned int i = 0; i < n; i++)
+            if(members[i]->sponsor(level) && members[i]->has_sibling(level))
+                tree_announce(members, n, i, level);
+
+    unsigned int failed = 0;
+    bool ok = tree_agree(members, n);
+    if(ok)
+        cout << "OK! Group key = " << members[0]->key() << " after " << rounds << " rounds" << endl;
+    else
+        cout << "ERROR! Group keys do not match!" << endl;
+    failed += !ok;
+
+    // A rekey by the last member only refreshes its path
+    typename TGDH::Shared_Key old_key = members[0]->key();
+    members[n - 1]->rotate_key();
+    for(unsigned int level = 0; level < members[n - 1]->depth(); level++)
+        if(members[n - 1]->has_sibling(level))
+            tree_announce(members, n, n - 1, level);
+
+    ok = tree_agree(members, n) && !(members[0]->key() == old_key);
+    if(ok)
+        cout << "OK! Group key after rekey = " << members[0]->key() << endl;
+    else
+        cout << "ERROR! Group keys do not match after rekey!" << endl;
+    failed += !ok;
+
+    for(unsigned int i = 0; i < n; i++)
+        delete members[i];
+
+    return failed;
+}
+
+template<unsigned int BITS, unsigned int MAX_MEMBERS>
+unsigned int burmester_desmedt_test(unsigned int n)
+{
+    typedef Burmester_Desmedt_Group_Diffie_Hellman<BITS, MAX_MEMBERS> BD;
+
+    cout << endl;
+    cout << "Burmester_Desmedt_Group_Diffie_Hellman<" << BITS << ", " << MAX_MEMBERS << "> with " << n << " members" << endl;
+    cout << "sizeof(Burmester_Desmedt_Group_Diffie_Hellman) = " << sizeof(BD) << endl;
+
+    BD * members[MAX_MEMBERS];
+    for(unsigned int i = 0; i < n; i++)
+        members[i] = new BD(BD::default_parameters(), i, n);
+
+    // Each round is a single broadcast by every member
+    for(unsigned int i = 0; i < n; i++) {
+        typename BD::Round_Key z = members[i]->first_round();
+        for(unsigned int j = 0; j < n; j++)
+            if(j != i)
+                members[j]->first_round(i, z);
+    }
+    for(unsigned int i = 0; i < n; i++) {
+        typename BD::Round_Key x = members[i]->second_round();
+        for(unsigned int j = 0; j < n; j++)
+            if(j != i)
+                members[j]->second_round(i, x);
+    }
+
+    bool ok = true;
+    for(unsigned int i = 0; i < n; i++)
+        ok = ok && members[i]->ready() && (members[i]->key() == members[0]->key());
+
+    if(ok)
+        cout << "OK! Group key = " << members[0]->key() << endl;
+    else
+        cout << "ERROR! Group keys do not match!" << endl;
+
+    for(unsigned int i = 0; i < n; i++)
+        delete members[i];
+
+    return !ok;
+}
+
+int main()
+{
+    unsigned int seed = Random::random();
+    Random::seed(seed);
+
+    cout << "EPOS Group Diffie-Hellman Test" << endl;
+    cout << "Random seed = " << seed << endl;
+
+    unsigned int tests_failed = 0;
+
+    tests_failed += test<32, 0>(ITERATIONS);
+    tests_failed += test<32, 4>(ITERATIONS);
+    tests_failed += test<128, 0>(ITERATIONS);
+    tests_failed += test<256, 0>(MODP_ITERATIONS);
+    tests_failed += test<256, 4>(MODP_ITERATIONS);
+    tests_failed += elliptic_curve_test(MODP_ITERATIONS);
+    tests_failed += ladder_test<32>(ITERATIONS);
+    tests_failed += ladder_test<128>(ITERATIONS);
+    tests_failed += ladder_test<256>(MODP_ITERATIONS);
+    tests_failed += Montgomery_Test<32>::test();
+    tests_failed += Montgomery_Test<128>::test();
+    tests_failed += Montgomery_Test<256>::test();
+    tests_failed += tree_test<32, 4>(1);
+    tests_failed += tree_test<32, 4>(2);
+    tests_failed += tree_test<32, 4>(7);
+    tests_failed += tree_test<32, 4>(16);
+    tests_failed += tree_test<256, 3>(5);
+    tests_failed += burmester_desmedt_test<32, 16>(2);
+    tests_failed += burmester_desmedt_test<32, 16>(3);
+    tests_failed += burmester_desmedt_test<32, 16>(16);
+    tests_failed += burmester_desmedt_test<256, 8>(5);
+
     cout << endl;
     cout << "Tests finished with " << tests_failed << " error" << (tests_failed > 1 ? "s" : "") << " detected." << endl;
     cout << endl;
@@ -248,81 +248,752 @@ volatile bool TSTP::Security::_peers_lock;
 Thread * TSTP::Security::_key_manager;
 unsigned int TSTP::Security::_dh_requests_open;
 
-typedef Group_Diffie_Hellman::Round_Key Round_Key;
-typedef Group_Diffie_Hellman::Shared_Key Shared_Key;
-typedef Group_Diffie_Hellman::Group_Id Group_Id;
+typedef TSTP::GDH::Round_Key Round_Key;
+typedef TSTP::GDH::Shared_Key Shared_Key;
+typedef TSTP::GDH::Group_Id Group_Id;
 
-Group_Diffie_Hellman TSTP::GDH_Security::_gdh;
-TSTP::GDH_State TSTP::GDH_Security::_GDH_state;
-TSTP::GDH_Node_Type TSTP::GDH_Security::_GDH_node_type;
-Simple_List<TSTP::Region::Space> TSTP::GDH_Security::_GDH_next;
-Shared_Key TSTP::GDH_Security::_GDH_key;
+// TSTP::Crypto_Worker
+// Class attributes
+TSTP::Crypto_Worker::Frame_Job TSTP::Crypto_Worker::_frames[FRAMES];
+Handler * TSTP::Crypto_Worker::_jobs[JOBS];
+unsigned int TSTP::Crypto_Worker::_head;
+unsigned int TSTP::Crypto_Worker::_count;
+Semaphore TSTP::Crypto_Worker::_pending(0);
+Thread * TSTP::Crypto_Worker::_thread;
+
+// Methods
+// Called from the NIC receive path: the frame is copied, so buf can be released as soon as this returns
+bool TSTP::Crypto_Worker::submit(Function * function, Buffer * buf)
+{
+    bool disabled = CPU::int_disabled();
+    CPU::int_disable();
+    Frame_Job * job = 0;
+    for(unsigned int i = 0; i < FRAMES; i++)
+        if(!_frames[i].busy()) {
+            job = &_frames[i];
+            job->load(function, buf);
+            break;
+        }
+    if(!disabled)
+        CPU::int_enable();
+
+    if(!job) {
+        db<TSTP>(WRN) << "TSTP::Crypto_Worker::submit(f=" << reinterpret_cast<void *>(function) << ",buf=" << buf << "): frame dropped!" << endl;
+        return false;
+    }
+
+    if(!submit(job)) {
+        job->unload();
+        return false;
+    }
+    return true;
+}
+
+// A job that is still queued is not queued again (it will run once, after this call)
+bool TSTP::Crypto_Worker::submit(Handler * job)
+{
+    db<TSTP>(TRC) << "TSTP::Crypto_Worker::submit(job=" << job << ")" << endl;
+
+    bool disabled = CPU::int_disabled();
+    CPU::int_disable();
+    bool pending = false;
+    for(unsigned int i = 0; (i < _count) && !pending; i++)
+        pending = (_jobs[(_head + i) % JOBS] == job);
+    bool queued = pending || (_count < JOBS);
+    if(queued && !pending) {
+        _jobs[(_head + _count) % JOBS] = job;
+        _count++;
+    }
+    if(!disabled)
+        CPU::int_enable();
+
+    if(queued && !pending)
+        _pending.v();
+    else if(!queued)
+        db<TSTP>(WRN) << "TSTP::Crypto_Worker::submit(job=" << job << "): queue full!" << endl;
+
+    return queued;
+}
+
+// Jobs still queued are removed (e.g. the timeout of a group that has just ended); work() skips the extra posts of _pending
+void TSTP::Crypto_Worker::cancel(Handler * job)
+{
+    bool disabled = CPU::int_disabled();
+    CPU::int_disable();
+    unsigned int kept = 0;
+    for(unsigned int i = 0; i < _count; i++)
+        if(_jobs[(_head + i) % JOBS] != job) {
+            _jobs[(_head + kept) % JOBS] = _jobs[(_head + i) % JOBS];
+            kept++;
+        }
+    _count = kept;
+    if(!disabled)
+        CPU::int_enable();
+}
+
+void TSTP::Crypto_Worker::init()
+{
+    db<TSTP>(TRC) << "TSTP::Crypto_Worker::init()" << endl;
+
+    _thread = new (SYSTEM) Thread(Thread::Configuration(Thread::READY, Thread::NORMAL), &work);
+}
+
+int TSTP::Crypto_Worker::work()
+{
+    while(true) {
+        _pending.p();
+
+        CPU::int_disable();
+        Handler * job = 0;
+        if(_count) {
+            job = _jobs[_head];
+            _head = (_head + 1) % JOBS;
+            _count--;
+        }
+        CPU::int_enable();
+
+        if(job)
+            (*job)();
+    }
+
+    return 0;
+}
+
+
+// TSTP::GDH_Security
+// Class attributes
+TSTP::GDH_Security::GDH_Contexts TSTP::GDH_Security::_contexts;
+Group_Id TSTP::GDH_Security::_last_group_id;
+TSTP::GDH_Security::Key_Observed TSTP::GDH_Security::_key_observed;
+TSTP::GDH::Key_Pair TSTP::GDH_Security::_key_pool[GDH_KEY_POOL];
+TSTP::Time TSTP::GDH_Security::_key_pool_times[GDH_KEY_POOL];
+TSTP::Parameters TSTP::GDH_Security::_key_pool_parameters(TSTP::GDH::default_parameters());
+volatile unsigned int TSTP::GDH_Security::_pooled_keys;
+Function_Handler TSTP::GDH_Security::_fill_key_pool_handler(&fill_key_pool);
+Function_Handler TSTP::GDH_Security::_release_handler(&release);
+Mutex TSTP::GDH_Security::_lock;
+
+//Context of group_id, if this node takes part in it. With create, a fresh context replaces any previous one
+//(0 if GDH_MAX_GROUPS groups are already running). Called with _lock held
+TSTP::GDH_Security::GDH_Context * TSTP::GDH_Security::context(const Group_Id & group_id, bool create)
+{
+	GDH_Contexts::Element * el = _contexts.search_key(group_id);
+	if(!create)
+		return (el && (el->object()->_state != GDH_ENDED)) ? el->object() : 0;
+
+	if(el)
+		delete el->object();
+	if(_contexts.size() >= GDH_MAX_GROUPS) {
+		db<TSTP>(WRN) << "TSTP::GDH_Security::context(g=" << group_id << "): too many groups!" << endl;
+		return 0;
+	}
+	return new GDH_Context(group_id);
+}
+
+//Group ids are handed out by the gateway, which starts every group
+Group_Id TSTP::GDH_Security::new_group_id()
+{
+	do
+		_last_group_id = (_last_group_id + 1) & 0x7fffffff;
+	while(!_last_group_id || _contexts.search_key(_last_group_id)); //ended groups keep their ids until release()
+	return _last_group_id;
+}
+
+//Releases the context of group_id on this node
+//A Crypto_Worker job may be about to run on the context, so the context is only marked GDH_ENDED here and the
+//Crypto_Worker deletes it, in release()
+void TSTP::GDH_Security::end_group(const Group_Id & group_id)
+{
+    db<TSTP>(TRC) << "TSTP::GDH_Security::end_group(g=" << group_id << ")" << endl;
+
+	_lock.lock();
+	GDH_Context * ctx = context(group_id);
+	if(ctx) {
+		ctx->_state = GDH_ENDED;
+		Crypto_Worker::submit(&_release_handler);
+	}
+	_key_observed.notify(group_id); //whoever waits on it gives up
+	_lock.unlock();
+}
+
+//Runs in the Crypto_Worker, the only thread that deletes contexts, so none of its jobs is left with a deleted one
+void TSTP::GDH_Security::release()
+{
+	_lock.lock();
+	for(unsigned int i = 0; i < GDH_MAX_GROUPS; i++) {
+		GDH_Contexts::Element * next;
+		for(GDH_Contexts::Element * el = _contexts[i]->head(); el; el = next) {
+			next = el->next();
+			if(el->object()->_state == GDH_ENDED)
+				delete el->object();
+		}
+	}
+	_lock.unlock();
+}
+
+//Key agreed by group_id, or a null key while the group is not ready (use ready() or wait_key() to tell them apart)
+Shared_Key TSTP::GDH_Security::key(const Group_Id & group_id)
+{
+	_lock.lock();
+	GDH_Context * ctx = context(group_id);
+	Shared_Key key = (ctx && (ctx->_state == GDH_READY)) ? ctx->_key : Shared_Key();
+	_lock.unlock();
+	return key;
+}
+
+bool TSTP::GDH_Security::ready(const Group_Id & group_id)
+{
+	_lock.lock();
+	GDH_Context * ctx = context(group_id);
+	bool ready = ctx && (ctx->_state == GDH_READY);
+	_lock.unlock();
+	return ready;
+}
+
+//Blocks the calling thread until the key of group_id is ready, the group fails or timeout (0 = no timeout) expires
+//Returns whether the key is ready
+bool TSTP::GDH_Security::wait_key(const Group_Id & group_id, const Microsecond & timeout)
+{
+    db<TSTP>(TRC) << "TSTP::GDH_Security::wait_key(g=" << group_id << ",t=" << timeout << ")" << endl;
+
+	Semaphore sem(0);
+	Key_Waiter waiter(&sem);
+
+	_lock.lock();
+	_key_observed.attach(&waiter, group_id);
+	GDH_Context * ctx = context(group_id);
+	bool pending = ctx && (ctx->_state != GDH_READY) && (ctx->_state != GDH_FAILED);
+	_lock.unlock();
+
+	if(pending) {
+		if(timeout) {
+			Semaphore_Handler handler(&sem);
+			Alarm alarm(timeout, &handler, 1);
+			sem.p();
+		} else
+			sem.p();
+	}
+
+	_lock.lock();
+	_key_observed.detach(&waiter, group_id);
+	_lock.unlock();
+
+	return ready(group_id);
+}
+
+//Gives ctx a fresh private key for params, taken from the key pool whenever it was filled for params
+//A mismatch or a stale key empties the pool, which the Crypto_Worker then refills for params
+void TSTP::GDH_Security::new_key(GDH_Context * ctx, const Parameters & params)
+{
+	bool pooled = false;
+	bool refill = false;
+	GDH::Key_Pair pair;
+
+	CPU::int_disable();
+	if(!(params.q() == _key_pool_parameters.q()) || !(params.base() == _key_pool_parameters.base())) {
+		flush_key_pool();
+		_key_pool_parameters = params;
+		refill = true;
+	} else if(_pooled_keys) {
+		//keys are pooled in order, so when the newest one is stale, so are all the others
+		if(TSTP::now() - _key_pool_times[_pooled_keys - 1] < GDH_KEY_POOL_LIFETIME) {
+			pair = _key_pool[--_pooled_keys];
+			_key_pool[_pooled_keys] = GDH::Key_Pair();
+			pooled = true;
+		} else
+			flush_key_pool();
+		refill = true;
+	}
+	CPU::int_enable();
+
+	if(pooled)
+		ctx->chain(GDH(params, pair));
+	else
+		ctx->chain(GDH(params));
+	if(refill)
+		Crypto_Worker::submit(&_fill_key_pool_handler);
+
+	db<TSTP>(TRC) << "TSTP::GDH_Security::new_key(g=" << ctx->id() << ",pooled=" << pooled << ")" << endl;
+}
+
+//Runs in the Crypto_Worker, after bootstrap and whenever the pool is drawn from or flushed
+//Keys drawn for parameters the pool no longer holds are discarded
+void TSTP::GDH_Security::fill_key_pool()
+{
+	CPU::int_disable();
+	Parameters params = _key_pool_parameters;
+	CPU::int_enable();
+
+	GDH gdh(params);
+	while(_pooled_keys < GDH_KEY_POOL) {
+		GDH::Key_Pair pair = gdh.key_pair();
+		CPU::int_disable();
+		bool current = (params.q() == _key_pool_parameters.q()) && (params.base() == _key_pool_parameters.base());
+		if(current && (_pooled_keys < GDH_KEY_POOL)) {
+			_key_pool_times[_pooled_keys] = TSTP::now();
+			_key_pool[_pooled_keys++] = pair;
+		}
+		CPU::int_enable();
+		if(!current)
+			break; //new_key() has already asked for a refill with the new parameters
+	}
+}
+
+//Wipes the pooled private keys. Called with interrupts disabled
+void TSTP::GDH_Security::flush_key_pool()
+{
+	for(unsigned int i = 0; i < GDH_KEY_POOL; i++)
+		_key_pool[i] = GDH::Key_Pair();
+	_pooled_keys = 0;
+}
+
+//Sends a message that expects an answer, keeping a copy to retransmit if the answer doesn't come within GDH_TIMEOUT
+void TSTP::GDH_Security::transmit(GDH_Context * ctx, Buffer * buf)
+{
+	if(buf->size() <= sizeof(ctx->_retained)) {
+		memcpy(ctx->_retained, buf->frame(), buf->size());
+		ctx->_retained_size = buf->size();
+	}
+	ctx->_tries = 0;
+	set_timeout(ctx);
+	TSTP::_nic->send(buf);
+}
+
+void TSTP::GDH_Security::set_timeout(GDH_Context * ctx)
+{
+	if(ctx->_alarm)
+		delete ctx->_alarm;
+
+	ctx->_alarm = new (SYSTEM) Alarm(GDH_TIMEOUT, &ctx->_expired_handler);
+	ctx->_alarm_serial++;
+}
+
+//Alarm handler: retransmissions may need key arithmetic (TGDH, BD), so they are left to the Crypto_Worker
+//The serial tells timeout() whether the alarm that fired is still the current one
+void TSTP::GDH_Security::expired(GDH_Context * ctx)
+{
+	ctx->_expired_serial = ctx->_alarm_serial;
+	Crypto_Worker::submit(&ctx->_timeout_handler);
+}
+
+void TSTP::GDH_Security::timeout(GDH_Context * ctx)
+{
+    db<TSTP>(TRC) << "TSTP::GDH_Security::timeout(g=" << ctx->id() << ",state=" << ctx->_state << ",tries=" << ctx->_tries << ")" << endl;
+
+	_lock.lock();
+
+	if(ctx->_expired_serial != ctx->_alarm_serial) {
+		//the alarm that fired was replaced (e.g. by transmit()) before this job ran, so the fresh one stays
+		_lock.unlock();
+		return;
+	}
+
+	delete ctx->_alarm;
+	ctx->_alarm = 0;
+
+	if(ctx->_state == GDH_ENDED) {
+		_lock.unlock();
+		return;
+	}
+
+	if((TSTP::here() == TSTP::sink()) && ctx->_batch_count)
+		flush_batch(ctx); //answers whoever already responded, without waiting for the missing ones
+
+	if((ctx->_state == GDH_READY) || (ctx->_state == GDH_FAILED)) {
+		_lock.unlock();
+		return;
+	}
+
+	if(ctx->_tries == GDH_RETRIES) {
+		ctx->_state = GDH_FAILED;
+		db<TSTP>(WRN) << "TSTP::GDH_Security::timeout(g=" << ctx->id() << "): group key agreement failed!" << endl;
+		_key_observed.notify(ctx->id());
+		_lock.unlock();
+		return;
+	}
+	ctx->_tries++;
+
+	if(ctx->_node_type == GDH_TREE)
+		tree_announce(ctx, 0, ctx->tgdh().height() + 1, true); //receivers just overwrite the blinded keys they already have
+	else if(ctx->_node_type == GDH_BURMESTER_DESMEDT) {
+		bd_round(ctx, BD_FIRST_ROUND, ctx->bd().first_round());
+		if(ctx->_state == GDH_WAITING_FINAL)
+			bd_round(ctx, BD_SECOND_ROUND, ctx->bd().second_round());
+	} else if((TSTP::here() == TSTP::sink()) && (ctx->_state == GDH_WAITING_GW) && !ctx->_rekey_pending) {
+		db<TSTP>(INF) << "Retransmitting the GDH Chain Setups of group " << ctx->id() << " (" << ctx->_tries << "/" << GDH_RETRIES << ")" << endl;
+		chain_setup(ctx); //members that already got theirs draw a fresh share and the chain starts over
+	} else if(ctx->_retained_size) {
+		Buffer * buf = TSTP::alloc(ctx->_retained_size);
+		memcpy(buf->frame(), ctx->_retained, ctx->_retained_size);
+		buf->frame()->data<Header>()->time(TSTP::now());
+		TSTP::marshal(buf);
+		db<TSTP>(INF) << "Retransmitting the last GDH message of group " << ctx->id() << " (" << ctx->_tries << "/" << GDH_RETRIES << ")" << endl;
+		TSTP::_nic->send(buf);
+	}
+	set_timeout(ctx);
+
+	_lock.unlock();
+}
+
+//The group key is established (or refreshed). Setup time is measured from the creation of the context
+void TSTP::GDH_Security::key_ready(GDH_Context * ctx, const Shared_Key & key)
+{
+	ctx->_key = key;
+	ctx->_state = GDH_READY;
+	//the gateway keeps its alarm while members' GDH_Responses are pending, to answer them even if some never arrive
+	if(ctx->_alarm && !((TSTP::here() == TSTP::sink()) && ctx->_batch_count)) {
+		delete ctx->_alarm;
+		ctx->_alarm = 0;
+		ctx->_alarm_serial++;
+	}
+
+	db<TSTP>(INF) << "TSTP::GDH_Security::key_ready(g=" << ctx->id() << ",t=" << TSTP::now() - ctx->_started << ")" << endl;
+
+	_key_observed.notify(ctx->id());
+}
 
 //Function executed by the gateway to begin the key exchange algorithm
+//The chain follows the list order (head is the first member, tail the last) and is described by GDH_Chain_Setups
 Group_Id TSTP::GDH_Security::begin_group_diffie_hellman(Simple_List<Region::Space> nodes)
 {
     db<TSTP>(TRC) << "TSTP::GDH_Security::begin_group_diffie_hellman()" << endl;
-    kout << "TSTP::GDH_Security::begin_group_diffie_hellman()" << endl;
 
-	Group_Id group_id = 1/*TODO GDH random?*/;
+	if((TSTP::here() != TSTP::sink()) || (nodes.size() < 2) || (nodes.size() > GDH_MAX_MEMBERS)) {
+		//only the gateway should run this function
+		return -1;
+	}
 
-	if(TSTP::here() != TSTP::sink()) {
+	_lock.lock();
+	Group_Id group_id = new_group_id();
+	GDH_Context * ctx = context(group_id, true);
+	if(!ctx) {
+		_lock.unlock();
+		return -1;
+	}
+
+	ctx->_pending_responses = nodes.size(); // every member sends one GDH_Response
+	ctx->_batch_count = 0;
+	ctx->_rekey_pending = false;
+	ctx->_partials_valid = true;
+
+	ctx->_member_count = 0;
+	for(auto it = nodes.begin(); it; it++)
+		ctx->_members[ctx->_member_count++] = *it->object();
+
+	chain_setup(ctx);
+
+	ctx->_state = GDH_WAITING_GW;
+	set_timeout(ctx);
+	_lock.unlock();
+	return group_id;
+}
+
+//Sends the GDH_Chain_Setups describing ctx->_members; they are rebuilt from the members on every retransmission
+void TSTP::GDH_Security::chain_setup(GDH_Context * ctx)
+{
+	Parameters params = ctx->gdh().parameters();
+
+	for(unsigned int first = 0; ; ) {
+		Buffer* resp = TSTP::alloc(sizeof(GDH_Chain_Setup));
+		GDH_Chain_Setup * setup = new (resp->frame()) GDH_Chain_Setup(ctx->id(), params, ctx->_members, first, ctx->_member_count);
+		TSTP::marshal(resp);
+		db<TSTP>(INF) << "Sending GDH Chain Setup with members " << first << " to " << first + setup->count() - 1 << " of " << ctx->_member_count << " to " << setup->destination() << endl;
+		TSTP::_nic->send(resp);
+		if(first + setup->count() >= ctx->_member_count)
+			break;
+		first += setup->owned();
+	}
+}
+
+//Function executed by the gateway to begin the tree-based key agreement (TGDH)
+//The gateway is leaf 0 and the nodes follow in list order. The key is ready after O(log N) rounds of TGDH_Blinded messages
+Group_Id TSTP::GDH_Security::begin_tree_group_diffie_hellman(Simple_List<Region::Space> nodes)
+{
+    db<TSTP>(TRC) << "TSTP::GDH_Security::begin_tree_group_diffie_hellman()" << endl;
+
+	unsigned int members = nodes.size() + 1;
+	if((TSTP::here() != TSTP::sink()) || (members < 2) || (members > TGDH::MAX_MEMBERS)) {
 		//only the gateway should run this function
 		return -1;
 	}
 
-	_gdh = Group_Diffie_Hellman();
-	Parameters params = _gdh.parameters();
+	_lock.lock();
+	Group_Id group_id = new_group_id();
+	GDH_Context * ctx = context(group_id, true);
+	if(!ctx) {
+		_lock.unlock();
+		return -1;
+	}
 
-	Region::Space *last = nodes.remove_tail()->object();
+	Region::Space leaves[TGDH::MAX_MEMBERS];
+	leaves[0] = Region::Space(TSTP::here());
+	unsigned int leaf = 1;
+	for(auto it = nodes.begin(); it; it++, leaf++)
+		leaves[leaf] = *it->object();
 
-	auto gw = Region::Space(TSTP::here());
+	ctx->tree(TGDH(TGDH::default_parameters(), 0, members));
+	Parameters params = ctx->tgdh().parameters();
 
-	Buffer* resp = TSTP::alloc(sizeof(GDH_Setup_Last));
-	new (resp->frame()) GDH_Setup_Last(group_id, *last, params, gw);
-	TSTP::marshal(resp);
-	kout << "Sending Setup Last to " << *last << " with next: " << gw << endl;
-	TSTP::_nic->send(resp);
+	Region::Space siblings[TGDH_DEPTH];
+	for(leaf = 1; leaf < members; leaf++) {
+		tree_siblings(siblings, leaves, leaf, members);
+		Buffer* resp = TSTP::alloc(sizeof(TGDH_Setup));
+		new (resp->frame()) TGDH_Setup(group_id, leaves[leaf], params, leaf, members, siblings);
+		TSTP::marshal(resp);
+		db<TSTP>(INF) << "Sending TGDH Setup to " << leaves[leaf] << " as leaf " << leaf << endl;
+		TSTP::_nic->send(resp);
+	}
+
+	tree_siblings(ctx->_tree_siblings, leaves, 0, members);
+	ctx->_state = GDH_WAITING_FINAL;
+	set_timeout(ctx);
+	tree_announce(ctx, 0, 1, true);
+	if(ctx->tgdh().ready())
+		key_ready(ctx, ctx->tgdh().key());
+	_lock.unlock();
+
+	return group_id;
+}
+
+//Draws a new leaf secret and announces the new blinded keys on its path: O(log N) messages and exponentiations
+void TSTP::GDH_Security::refresh_tree_group_diffie_hellman(const Group_Id & group_id)
+{
+    db<TSTP>(TRC) << "TSTP::GDH_Security::refresh_tree_group_diffie_hellman(g=" << group_id << ")" << endl;
+
+	_lock.lock();
+	GDH_Context * ctx = context(group_id);
+	if(ctx && (ctx->_node_type == GDH_TREE)) {
+		ctx->tgdh().rotate_key();
+		tree_announce(ctx, 0, ctx->tgdh().depth(), false);
+		if(ctx->tgdh().ready())
+			key_ready(ctx, ctx->tgdh().key());
+	}
+	_lock.unlock();
+}
+
+//Sends the blinded keys of this node's blocks for levels [from, to) to the sibling blocks
+void TSTP::GDH_Security::tree_announce(GDH_Context * ctx, unsigned int from, unsigned int to, bool sponsor_only)
+{
+	for(unsigned int level = from; (level < to) && (level < ctx->tgdh().depth()) && (level <= ctx->tgdh().height()); level++) {
+		if(!ctx->tgdh().has_sibling(level) || (sponsor_only && !ctx->tgdh().sponsor(level)))
+			continue;
+
+		Buffer* resp = TSTP::alloc(sizeof(TGDH_Blinded));
+		new (resp->frame()) TGDH_Blinded(ctx->id(), ctx->_tree_siblings[level], level, ctx->tgdh().block(level), ctx->tgdh().blinded_key(level));
+		TSTP::marshal(resp);
+		db<TSTP>(INF) << "Sending TGDH Blinded key of level " << level << " to " << ctx->_tree_siblings[level] << endl;
+		TSTP::_nic->send(resp);
+	}
+}
+
+//For each level, the space enclosing the members of the sibling block of leaf
+void TSTP::GDH_Security::tree_siblings(Region::Space * siblings, const Region::Space * leaves, unsigned int leaf, unsigned int members)
+{
+	for(unsigned int level = 0; level < TGDH_DEPTH; level++) {
+		unsigned int first = ((leaf >> level) ^ 1) << level;
+		unsigned int last = first + (1 << level);
+		if(last > members)
+			last = members;
+		if(first < members)
+			siblings[level] = gdh_enclosing_space(&leaves[first], last - first);
+		else
+			siblings[level] = Region::Space(Region::Center());
+	}
+}
+
+//Function executed by the gateway to begin the Burmester-Desmedt key agreement
+//The gateway is member 0 of the ring and the nodes follow in list order. Every member broadcasts once in each of the two rounds
+Group_Id TSTP::GDH_Security::begin_burmester_desmedt(Simple_List<Region::Space> nodes)
+{
+    db<TSTP>(TRC) << "TSTP::GDH_Security::begin_burmester_desmedt()" << endl;
+
+	unsigned int members = nodes.size() + 1;
+	if((TSTP::here() != TSTP::sink()) || (members < 2) || (members > BD_MAX_MEMBERS)) {
+		//only the gateway should run this function
+		return -1;
+	}
+
+	_lock.lock();
+	Group_Id group_id = new_group_id();
+	GDH_Context * ctx = context(group_id, true);
+	if(!ctx) {
+		_lock.unlock();
+		return -1;
+	}
 
-	Region::Space* first = nodes.remove_head()->object();
+	Region::Space ring[BD_MAX_MEMBERS];
+	ring[0] = Region::Space(TSTP::here());
+	unsigned int index = 1;
+	for(auto it = nodes.begin(); it; it++, index++)
+		ring[index] = *it->object();
+	ctx->_bd_group = gdh_enclosing_space(ring, members);
 
-	for(auto it = nodes.begin(); it; it++) {
-		resp = TSTP::alloc(sizeof(GDH_Setup_Last_Follow));
-		new (resp->frame()) GDH_Setup_Last_Follow(group_id, *last, *it->object(), false);
+	ctx->burmester_desmedt(BD(BD::default_parameters(), 0, members));
+	Parameters params = ctx->bd().parameters();
+
+	for(index = 1; index < members; index++) {
+		Buffer* resp = TSTP::alloc(sizeof(BD_Setup));
+		new (resp->frame()) BD_Setup(group_id, ring[index], params, index, members, ctx->_bd_group);
 		TSTP::marshal(resp);
-		kout << "Sending GDH Setup Last Follow to "<< *last << " with next = "<< *it->object() << ", " << false << endl;
+		db<TSTP>(INF) << "Sending BD Setup to " << ring[index] << " as member " << index << endl;
 		TSTP::_nic->send(resp);
 	}
 
-	resp = TSTP::alloc(sizeof(GDH_Setup_Last_Follow));
-	new (resp->frame()) GDH_Setup_Last_Follow(group_id, *last, *first, true);
+	ctx->_state = GDH_WAITING_EXP;
+	set_timeout(ctx);
+	bd_round(ctx, BD_FIRST_ROUND, ctx->bd().first_round());
+	_lock.unlock();
+
+	return group_id;
+}
+
+void TSTP::GDH_Security::bd_round(GDH_Context * ctx, const Subtype & subtype, const Round_Key & round_key)
+{
+	Buffer* resp = TSTP::alloc(sizeof(BD_Round));
+	new (resp->frame()) BD_Round(subtype, ctx->id(), ctx->_bd_group, ctx->bd().index(), round_key);
 	TSTP::marshal(resp);
-	kout << "Sending GDH Setup Last Follow to "<< *last << " with next = "<< *first << ", " << true << endl;
+	db<TSTP>(INF) << "Broadcasting BD round " << (subtype == BD_FIRST_ROUND ? 1 : 2) << " key(" << round_key << ") to " << ctx->_bd_group << endl;
 	TSTP::_nic->send(resp);
+}
 
-	Region::Space* next = last;
-	if(nodes.size() > 0) {
-		for(auto it = nodes.begin(); it; it++) {
-			resp = TSTP::alloc(sizeof(GDH_Setup_Intermediate));
-			Region::Space *current = it->object();
-			new (resp->frame()) GDH_Setup_Intermediate(group_id, *current, params, *next);
-			TSTP::marshal(resp);
-			kout << "Sending Setup Intermediate to " << *current << endl;
-			TSTP::_nic->send(resp);
-			next = current;
-		}
+//Function executed by the gateway to add a node to an established chain group
+//The node becomes the new last member: only it, the former last member (which re-randomizes its share, so the node
+//cannot learn the previous key) and the gateway exponentiate. The others get the new key through a GDH_Rekey
+bool TSTP::GDH_Security::join_group(const Group_Id & group_id, const Region::Space & node)
+{
+    db<TSTP>(TRC) << "TSTP::GDH_Security::join_group(g=" << group_id << ",n=" << node << ")" << endl;
+
+	_lock.lock();
+	GDH_Context * ctx = context(group_id);
+	if((TSTP::here() != TSTP::sink()) || !ctx || (ctx->_member_count == 0) || (ctx->_member_count >= GDH_MAX_MEMBERS)) {
+		_lock.unlock();
+		return false;
 	}
 
-	Region::Space* firsts_next = nodes.head()->object();
+	Region::Space last = ctx->_members[ctx->_member_count - 1];
+	ctx->_members[ctx->_member_count++] = node;
+	ctx->_pending_responses = 1;
+	ctx->_batch_count = 0;
+	ctx->_rekey_pending = true;
+	ctx->_partials_valid = false; //the former members' partial keys lack the new shares
+	ctx->_state = GDH_WAITING_GW;
+	set_timeout(ctx);
+
+	auto gw = Region::Space(TSTP::here());
 
-	resp = TSTP::alloc(sizeof(GDH_Setup_First));
-	new (resp->frame()) GDH_Setup_First(group_id, *first, params, *firsts_next);
+	Buffer* resp = TSTP::alloc(sizeof(GDH_Setup_Last));
+	new (resp->frame()) GDH_Setup_Last(group_id, node, ctx->gdh().parameters(), gw);
 	TSTP::marshal(resp);
-	kout << "Sending Setup First to " << *first << endl;
+	db<TSTP>(INF) << "Sending Setup Last to joining node " << node << " with next: " << gw << endl;
 	TSTP::_nic->send(resp);
 
-	_GDH_state = GDH_WAITING_GW;
-	return group_id;
+	resp = TSTP::alloc(sizeof(GDH_Join));
+	new (resp->frame()) GDH_Join(group_id, last, node);
+	TSTP::marshal(resp);
+	db<TSTP>(INF) << "Sending GDH Join to " << last << " for " << node << endl;
+	TSTP::_nic->send(resp);
+	_lock.unlock();
+
+	return true;
+}
+
+//Function executed by the gateway to evict a node from an established chain group
+//The gateway is the re-randomizing node: it refreshes its share and re-exponentiates the partial keys it kept from
+//the members' GDH_Responses (the outputs of their remove_key()), skipping the evicted one. The remaining members
+//rederive the key with a single insert_key(), and the radio traffic is that of one batch broadcast, whatever the chain length
+bool TSTP::GDH_Security::leave_group(const Group_Id & group_id, const Region::Space & node)
+{
+    db<TSTP>(TRC) << "TSTP::GDH_Security::leave_group(g=" << group_id << ",n=" << node << ")" << endl;
+
+	_lock.lock();
+	GDH_Context * ctx = context(group_id);
+	if((TSTP::here() != TSTP::sink()) || !ctx || !ctx->_partials_valid || (ctx->_member_count < 2)) {
+		_lock.unlock();
+		return false;
+	}
+
+	unsigned int i = 0;
+	while((i < ctx->_member_count) && !ctx->_members[i].contains(node.center))
+		i++;
+	if(i == ctx->_member_count) {
+		_lock.unlock();
+		return false;
+	}
+
+	ctx->_member_count--;
+	for(; i < ctx->_member_count; i++) {
+		ctx->_members[i] = ctx->_members[i + 1];
+		ctx->_partial_keys[i] = ctx->_partial_keys[i + 1];
+	}
+
+	//the evicted node's share stays in the key, but it never learns the partial key under the new gateway share
+	new_key(ctx, ctx->gdh().parameters());
+	db<TSTP>(INF) << "Gateway evicted " << node << endl;
+	key_ready(ctx, ctx->gdh().insert_key(ctx->_round_key));
+
+	ctx->_batch_count = 0;
+	for(i = 0; i < ctx->_member_count; i++) {
+		ctx->_batch_members[ctx->_batch_count] = ctx->_members[i];
+		ctx->_batch_keys[ctx->_batch_count] = ctx->_partial_keys[i];
+		ctx->_batch_count++;
+		if((ctx->_batch_count == GDH_Batch_Broadcast::ENTRIES) || (i == ctx->_member_count - 1))
+			flush_batch(ctx);
+	}
+	_lock.unlock();
+
+	return true;
+}
+
+//Sends the new key to the holders of the current one (all members but those in excluded)
+void TSTP::GDH_Security::rekey(GDH_Context * ctx, const Shared_Key & key, const Region::Space & excluded)
+{
+    db<TSTP>(TRC) << "TSTP::GDH_Security::rekey(g=" << ctx->id() << ",x=" << excluded << ")" << endl;
+
+	Shared_Key masked = key;
+	masked ^= mask(ctx->_key, ctx->id());
+
+	Buffer* resp = TSTP::alloc(sizeof(GDH_Rekey));
+	new (resp->frame()) GDH_Rekey(ctx->id(), gdh_enclosing_space(ctx->_members, ctx->_member_count), excluded, masked);
+	TSTP::marshal(resp);
+	db<TSTP>(INF) << "Sending GDH Rekey to " << resp->frame()->data<GDH_Rekey>()->destination() << endl;
+	TSTP::_nic->send(resp);
+}
+
+//One-way mask derived from a group key (AES in counter mode keyed by it), so that whoever learns the
+//next key from a GDH_Rekey cannot recover the previous one
+Shared_Key TSTP::GDH_Security::mask(const Shared_Key & key, const Group_Id & group_id)
+{
+	Cipher cipher;
+
+	//the AES key is a Davies-Meyer hash of the whole group key (h = AES_m(h) ^ h over its zero-padded blocks m),
+	//so every bit of it counts even when it is longer or shorter than Cipher::KEY_SIZE
+	const unsigned char * k = reinterpret_cast<const unsigned char *>(&key);
+	unsigned char aes_key[Cipher::KEY_SIZE];
+	memset(aes_key, 0, sizeof(aes_key));
+	for(unsigned int offset = 0; offset < sizeof(Shared_Key); offset += Cipher::KEY_SIZE) {
+		unsigned char block[Cipher::KEY_SIZE];
+		unsigned char hash[Cipher::KEY_SIZE];
+		memset(block, 0, sizeof(block));
+		unsigned int size = sizeof(Shared_Key) - offset;
+		memcpy(block, &k[offset], (size < Cipher::KEY_SIZE) ? size : Cipher::KEY_SIZE);
+		cipher.encrypt(aes_key, block, hash);
+		for(unsigned int i = 0; i < Cipher::KEY_SIZE; i++)
+			aes_key[i] ^= hash[i];
+	}
+
+	unsigned char mask[sizeof(Shared_Key)];
+	for(unsigned int block = 0; block * Cipher::KEY_SIZE < sizeof(Shared_Key); block++) {
+		unsigned char counter[Cipher::KEY_SIZE];
+		unsigned char stream[Cipher::KEY_SIZE];
+		memset(counter, 0, sizeof(counter));
+		memcpy(counter, &group_id, sizeof(Group_Id));
+		counter[Cipher::KEY_SIZE - 1] = block;
+		cipher.encrypt(counter, aes_key, stream);
+		for(unsigned int i = 0; (i < Cipher::KEY_SIZE) && (block * Cipher::KEY_SIZE + i < sizeof(Shared_Key)); i++)
+			mask[block * Cipher::KEY_SIZE + i] = stream[i];
+	}
+
+	return Shared_Key(mask, sizeof(Shared_Key));
 }
 
 void TSTP::GDH_Security::update(NIC::Observed * obs, NIC::Protocol prot, Buffer * buf)
@@ -333,24 +1004,35 @@ void TSTP::GDH_Security::update(NIC::Observed * obs, NIC::Protocol prot, Buffer
 		return; //we dont care if the this is the type of the message
 	}
 
-	db<TSTP>(TRC) << "TSTP::GDH_Security::update(): Control message received" << endl;
+	Subtype subtype = buf->frame()->data<Control>()->subtype();
+	if((subtype >= GDH_SETUP_FIRST) && (subtype <= GDH_CHAIN_SETUP))
+		Crypto_Worker::submit(&process, buf); //the modular exponentiations don't run on the receive path
+}
+
+//Handles a GDH message in the Crypto_Worker
+void TSTP::GDH_Security::process(Buffer * buf)
+{
+	db<TSTP>(TRC) << "TSTP::GDH_Security::process(): Control message received" << endl;
 	/*kout << "TSTP::GDH_Security::update(): Control message received" << endl;
 	kout << "Message type: " << buf->frame()->data<Control>()->subtype() << endl;*/
 
 	auto author = buf->frame()->data<Header>()->origin();
 
+	_lock.lock();
 	switch(buf->frame()->data<Control>()->subtype()) {
 		case GDH_SETUP_FIRST: {
 			if(TSTP::here() != TSTP::sink()) {
-				db<TSTP>(TRC) << "TSTP::GDH_Security::update(): GDH SETUP FIRST message received" << endl;
-				kout << "TSTP::GDH_Security::update(): GDH SETUP FIRST message received from "  << author << endl;
+				db<TSTP>(TRC) << "TSTP::GDH_Security::update(): GDH SETUP FIRST message received from "  << author << endl;
 				GDH_Setup_First* message = buf->frame()->data<GDH_Setup_First>();
+				GDH_Context * ctx = context(message->group_id(), true);
+				if(!ctx)
+					break;
 				Region::Space next = message->next();
-				_gdh = Group_Diffie_Hellman(message->parameters());
-				Round_Key round_key = _gdh.insert_key();
+				new_key(ctx, message->parameters());
+				Round_Key round_key = ctx->gdh().insert_key();
 				//uses the randomly generated private key in the GDH object creation
-				_GDH_node_type = GDH_FIRST;
-				_GDH_state = GDH_WAITING_POP;
+				ctx->_node_type = GDH_FIRST;
+				ctx->_state = GDH_WAITING_POP;
 				//this node is waiting to remove its key from the round key
                 Buffer* resp = TSTP::alloc(sizeof(GDH_Round));
                 new (resp->frame()) GDH_Round(message->group_id(), next, round_key);
@@ -360,127 +1042,382 @@ void TSTP::GDH_Security::update(NIC::Observed * obs, NIC::Protocol prot, Buffer
 		} break;
 		case GDH_SETUP_INTERMEDIATE: {
 			if(TSTP::here() != TSTP::sink()) {
-				db<TSTP>(TRC) << "TSTP::GDH_Security::update(): GDH SETUP INTERMEDIATE message received" << endl;
-				kout << "TSTP::GDH_Security::update(): GDH SETUP INTERMEDIATE message received from " << author << endl;
+				db<TSTP>(TRC) << "TSTP::GDH_Security::update(): GDH SETUP INTERMEDIATE message received from " << author << endl;
 				GDH_Setup_Intermediate* message = buf->frame()->data<GDH_Setup_Intermediate>();
-				_gdh = Group_Diffie_Hellman(message->parameters());
-				_GDH_next = Simple_List<Region::Space>(); //only correct for the first group id
+				GDH_Context * ctx = context(message->group_id(), true);
+				if(!ctx)
+					break;
+				new_key(ctx, message->parameters());
 				List_Elements::Singly_Linked<Region::Space> *next = new List_Elements::Singly_Linked<Region::Space>(new Region::Space(message->next()));
-				_GDH_next.insert(next);
-				_GDH_node_type = GDH_INTERMEDIATE;
-				_GDH_state = GDH_WAITING_EXP; //this node is waiting to exponentiate the round key
+				ctx->_next.insert(next);
+				ctx->_node_type = GDH_INTERMEDIATE;
+				ctx->_state = GDH_WAITING_EXP; //this node is waiting to exponentiate the round key
 			}
 		} break;
 		case GDH_SETUP_LAST: {
 			if(TSTP::here() != TSTP::sink()) {
-				db<TSTP>(TRC) << "TSTP::GDH_Security::update(): GDH SETUP LAST message received" << endl;
 				GDH_Setup_Last* message = buf->frame()->data<GDH_Setup_Last>();
-				kout << "TSTP::GDH_Security::update(): GDH SETUP LAST message received from " << author << " with next = " << message->next() << endl;
+				db<TSTP>(TRC) << "TSTP::GDH_Security::update(): GDH SETUP LAST message received from " << author << " with next = " << message->next() << endl;
+				GDH_Context * ctx = context(message->group_id(), true);
+				if(!ctx)
+					break;
 				List_Elements::Singly_Linked<Region::Space> *next = new List_Elements::Singly_Linked<Region::Space>(new Region::Space(message->next()));
-				_GDH_next.insert(next);
-				_gdh = Group_Diffie_Hellman(message->parameters());
-				_GDH_node_type = GDH_LAST;
-				_GDH_state = GDH_WAITING_NEXT; //this node is waiting to receive all his next nodes
+				ctx->_next.insert(next);
+				new_key(ctx, message->parameters());
+				ctx->_node_type = GDH_LAST;
+				ctx->_state = GDH_WAITING_NEXT; //this node is waiting to receive all his next nodes
+			}
+		} break;
+		case GDH_CHAIN_SETUP: {
+			if(TSTP::here() == TSTP::sink())
+				break;
+			GDH_Chain_Setup* message = buf->frame()->data<GDH_Chain_Setup>();
+			Region::Space chain[GDH_Chain_Setup::MAX_ENTRIES];
+			unsigned int first = message->first();
+			unsigned int members = message->members();
+			if(!message->decode(chain) || (members < 1) || (members > GDH_MAX_MEMBERS) || (first + message->owned() > members)) {
+				db<TSTP>(WRN) << "TSTP::GDH_Security::update(): malformed GDH CHAIN SETUP dropped!" << endl;
+				break;
+			}
+			if(message->last().contains(TSTP::here())) {
+				//the last member collects the whole chain, but is ready as soon as it has every member (usually from a single frame)
+				GDH_Context * ctx = context(message->group_id());
+				if(!ctx || (ctx->_node_type != GDH_LAST) || (ctx->_state != GDH_WAITING_NEXT)) {
+					db<TSTP>(TRC) << "TSTP::GDH_Security::update(): GDH CHAIN SETUP message received from " << author << " as the last of " << members << endl;
+					ctx = context(message->group_id(), true);
+					if(!ctx)
+						break;
+					new_key(ctx, message->parameters());
+					ctx->_next.insert(new List_Elements::Singly_Linked<Region::Space>(new Region::Space(TSTP::sink())));
+					ctx->_chain_received = 1 << (members - 1);
+					ctx->_node_type = GDH_LAST;
+					ctx->_state = GDH_WAITING_NEXT;
+					set_timeout(ctx);
+				}
+				for(unsigned int i = 0; i < message->owned(); i++) {
+					if(ctx->_chain_received & (1 << (first + i)))
+						continue;
+					ctx->_chain_received |= 1 << (first + i);
+					ctx->_next.insert(new List_Elements::Singly_Linked<Region::Space>(new Region::Space(chain[i])));
+				}
+				if(ctx->_chain_received == (1U << members) - 1)
+					ctx->_state = GDH_WAITING_EXP;
+				break;
+			}
+			unsigned int i = 0;
+			while((i < message->owned()) && !chain[i].contains(TSTP::here()))
+				i++;
+			if((i == message->owned()) || (i + 1 == message->count()))
+				break; //not listed, listed only as the lookahead of the next fragment, or listed as the last member without being last()
+			db<TSTP>(TRC) << "TSTP::GDH_Security::update(): GDH CHAIN SETUP message received from " << author << " as member " << first + i << " of " << members << " with next = " << chain[i + 1] << endl;
+			GDH_Context * ctx = context(message->group_id(), true);
+			if(!ctx)
+				break;
+			new_key(ctx, message->parameters());
+			if(first + i == 0) {
+				Round_Key round_key = ctx->gdh().insert_key();
+				ctx->_node_type = GDH_FIRST;
+				ctx->_state = GDH_WAITING_POP; //this node is waiting to remove its key from the round key
+				Buffer* resp = TSTP::alloc(sizeof(GDH_Round));
+				new (resp->frame()) GDH_Round(message->group_id(), chain[i + 1], round_key);
+				TSTP::marshal(resp);
+				transmit(ctx, resp);
+			} else {
+				ctx->_next.insert(new List_Elements::Singly_Linked<Region::Space>(new Region::Space(chain[i + 1])));
+				ctx->_node_type = GDH_INTERMEDIATE;
+				ctx->_state = GDH_WAITING_EXP; //this node is waiting to exponentiate the round key
+				set_timeout(ctx);
 			}
 		} break;
 		case GDH_SETUP_LAST_FOLLOW: {
-			if(TSTP::here() != TSTP::sink() && _GDH_node_type == GDH_LAST && _GDH_state == GDH_WAITING_NEXT) {
-				db<TSTP>(TRC) << "TSTP::GDH_Security::update(): GDH SETUP LAST FOLLOW message received" << endl;
-				GDH_Setup_Last_Follow* message = buf->frame()->data<GDH_Setup_Last_Follow>();
-				kout << "TSTP::GDH_Security::update(): GDH SETUP LAST FOLLOW message received with next = " << message->next() << ", " << message->finished() << " from " << author << endl;
+			GDH_Setup_Last_Follow* message = buf->frame()->data<GDH_Setup_Last_Follow>();
+			GDH_Context * ctx = context(message->group_id());
+			if(TSTP::here() != TSTP::sink() && ctx && ctx->_node_type == GDH_LAST && ctx->_state == GDH_WAITING_NEXT) {
+				db<TSTP>(TRC) << "TSTP::GDH_Security::update(): GDH SETUP LAST FOLLOW message received with next = " << message->next() << ", " << message->finished() << " from " << author << endl;
 				List_Elements::Singly_Linked<Region::Space> *next = new List_Elements::Singly_Linked<Region::Space>(new Region::Space(message->next()));
-				_GDH_next.insert(next);
+				ctx->_next.insert(next);
 				if(message->finished()) {
-					_GDH_state = GDH_WAITING_EXP;
-					kout << "Last node changed to state GDH WAITING EXP";
+					ctx->_state = GDH_WAITING_EXP;
+					db<TSTP>(INF) << "Last node changed to state GDH WAITING EXP" << endl;
 				}
 			}
 		} break;
 		case GDH_ROUND: {
 			GDH_Round * message = buf->frame()->data<GDH_Round>();
+			GDH_Context * ctx = context(message->group_id());
 			Round_Key round_key = message->round_key();
-			if(TSTP::here() != TSTP::sink()) {
-				db<TSTP>(TRC) << "TSTP::GDH_Security::update(): GDH ROUND message received" << endl;
-				kout << "TSTP::GDH_Security::update(): GDH ROUND message received from " << author << endl;
-				switch(_GDH_node_type) {
+			if(TSTP::here() != TSTP::sink() && ctx) {
+				db<TSTP>(TRC) << "TSTP::GDH_Security::update(): GDH ROUND message received from " << author << endl;
+				switch(ctx->_node_type) {
 					case GDH_INTERMEDIATE: {
 						//calculate new partial key and send to next
-						round_key = _gdh.insert_key(round_key);
+						round_key = ctx->gdh().insert_key(round_key);
 						Buffer* resp = TSTP::alloc(sizeof(GDH_Round));
-						Region::Space* next = _GDH_next.head()->object();
+						Region::Space* next = ctx->_next.head()->object();
 						new (resp->frame()) GDH_Round(message->group_id(), *next, round_key);
 						TSTP::marshal(resp);
-						TSTP::_nic->send(resp);
-						_GDH_state = GDH_WAITING_POP;
+						if(ctx->_state == GDH_WAITING_EXP) {
+							transmit(ctx, resp);
+							ctx->_state = GDH_WAITING_POP;
+						} else
+							TSTP::_nic->send(resp); //a retransmission from upstream, which is stalled: pass it on towards the last node
 					} break;
 					case GDH_LAST: {
-						kout << "Last node received GDH_ROUND" << endl;
+						db<TSTP>(INF) << "Last node received GDH_ROUND" << endl;
 						//we will want the old round key here
-						Round_Key my_key = _gdh.insert_key(round_key);
+						ctx->_round_key = round_key; //kept to hand the chain on if a node joins later
+						Round_Key my_key = ctx->gdh().insert_key(round_key);
+						//send GDH_MULTI_BROADCAST with my_key, one frame for up to GDH_Multi_Broadcast::ENTRIES members
+						Region::Space members[GDH_Multi_Broadcast::ENTRIES];
+						unsigned int count = 0;
+						for(auto next_el = ctx->_next.begin(); next_el != ctx->_next.end(); ) {
+							members[count++] = *next_el->object();
+							next_el++;
+							if((count == GDH_Multi_Broadcast::ENTRIES) || (next_el == ctx->_next.end())) {
+								Buffer* resp = TSTP::alloc(sizeof(GDH_Multi_Broadcast));
+								new (resp->frame()) GDH_Multi_Broadcast(message->group_id(), members, count, my_key);
+								TSTP::marshal(resp);
+								db<TSTP>(INF) << "Last node sent GDH_MULTI_BROADCAST with my_key(" << my_key << ") to " << count << " members in " << resp->frame()->data<GDH_Multi_Broadcast>()->destination() << endl;
+								TSTP::_nic->send(resp);
+								count = 0;
+							}
+						}
+						//send GDH_RESPONSE with round_key (the one kept for retransmission: a lost multi-broadcast
+						//is recovered by the stalled members' retransmitted GDH_Rounds, which end up here again)
 						Buffer* resp = TSTP::alloc(sizeof(GDH_Response));
 						new (resp->frame()) GDH_Response(message->group_id(), TSTP::sink(), round_key);
 						TSTP::marshal(resp);
-						kout << "Last node sent GDH_RESPONSE with round key(" << round_key << ") to the gateway" << endl;
-						TSTP::_nic->send(resp);
-						_GDH_state = GDH_WAITING_FINAL;
-						//send GDH_RESPONSE with round_key
-						for(auto next_el = _GDH_next.begin(); next_el != _GDH_next.end(); next_el++) {
-							resp = TSTP::alloc(sizeof(GDH_Broadcast));
-							Region::Space* next = next_el->object();
-							new (resp->frame()) GDH_Broadcast(message->group_id(), *next, my_key);
-							TSTP::marshal(resp);
+						db<TSTP>(INF) << "Last node sent GDH_RESPONSE with round key(" << round_key << ") to the gateway" << endl;
+						if(ctx->_state != GDH_READY) {
+							transmit(ctx, resp);
+							ctx->_state = GDH_WAITING_FINAL;
+						} else
 							TSTP::_nic->send(resp);
-							kout << "Last node sent GDH_BROADCAST with my_key(" << my_key << ") to " << *next << endl;
-						}
-						//send GDH_BROADCAST with my_key
 					} break;
 					default: break;
 				}
 			}
 		} break;
 		case GDH_BROADCAST: {
-			//can be received from two nodes. Last and gateway
+			//the gateway's answer to a single GDH_Response
 			GDH_Broadcast* message = buf->frame()->data<GDH_Broadcast>();
-			db<TSTP>(TRC) << "TSTP::GDH_Security::update(): GDH BROADCAST message received" << endl;
-			kout << "TSTP::GDH_Security::update(): GDH BROADCAST message received from " << author << endl;
-			if(TSTP::here() != TSTP::sink()) {
-				if(_GDH_state == GDH_WAITING_POP) {
-					Round_Key round_key = message->round_key();
-					round_key = _gdh.remove_key(round_key);
-					Buffer* resp = TSTP::alloc(sizeof(GDH_Response));
-					new (resp->frame()) GDH_Response(message->group_id(), TSTP::sink(), round_key);
-					TSTP::marshal(resp);
-					kout << "Sending GDH Response with round key(" << round_key << ") to " << TSTP::sink() << endl;
-					TSTP::_nic->send(resp);
-					_GDH_state = GDH_WAITING_FINAL;
-				} else if(_GDH_state == GDH_WAITING_FINAL) {
-					Round_Key round_key = message->round_key();
-					round_key = _gdh.insert_key(round_key);
-					_GDH_key = round_key; //final key!
-					kout << "We calculated the final key! key = " << _GDH_key << endl;
-				}
-			} else { /*gateway*/
-				_GDH_key = _gdh.insert_key(message->round_key());
-				kout << "Gateway calculated his final key! Key = " << _GDH_key << endl;
-			}
+			GDH_Context * ctx = context(message->group_id());
+			if(!ctx)
+				break;
+			db<TSTP>(TRC) << "TSTP::GDH_Security::update(): GDH BROADCAST message received from " << author << endl;
+			chain_broadcast(ctx, message->round_key());
+		} break;
+		case GDH_MULTI_BROADCAST: {
+			//sent by the last node to all the others, the gateway included
+			GDH_Multi_Broadcast* message = buf->frame()->data<GDH_Multi_Broadcast>();
+			GDH_Context * ctx = context(message->group_id());
+			if(!ctx || !message->addressed_to(TSTP::here()))
+				break;
+			if((TSTP::here() != TSTP::sink()) && (ctx->_state != GDH_WAITING_POP))
+				break; //a retransmission for some other member
+			db<TSTP>(TRC) << "TSTP::GDH_Security::update(): GDH MULTI BROADCAST message received from " << author << endl;
+			chain_broadcast(ctx, message->round_key());
 		} break;
 		case GDH_RESPONSE: {
-			if(TSTP::here() == TSTP::sink()) {
+			GDH_Response* message = buf->frame()->data<GDH_Response>();
+			GDH_Context * ctx = context(message->group_id());
+			if(TSTP::here() == TSTP::sink() && ctx) {
 				db<TSTP>(TRC) << "TSTP::GDH_Security::update(): GDH RESPONSE message received from " << author << endl;
-				kout << "TSTP::GDH_Security::update(): GDH RESPONSE message received from " << author << endl;
-				GDH_Response* message = buf->frame()->data<GDH_Response>();
 				Region::Space origin = buf->frame()->data<Header>()->origin(); //source of the message. Address
 				Round_Key round_key = message->round_key();
-				round_key = _gdh.insert_key(round_key);
+				unsigned int member = 0;
+				while((member < ctx->_member_count) && !ctx->_members[member].contains(origin.center))
+					member++;
+				if(member == ctx->_member_count)
+					break;
+				ctx->_partial_keys[member] = round_key; //kept for leave_group()
+				if(GDH_BATCH && (ctx->_responded & (1 << member))) {
+					//a retransmission: the member missed its batch, so it gets its own GDH_Broadcast (unless it's still being batched)
+					bool batched = false;
+					for(unsigned int i = 0; i < ctx->_batch_count; i++)
+						batched = batched || ctx->_batch_members[i].contains(origin.center);
+					if(batched)
+						break;
+				} else if(GDH_BATCH) {
+					ctx->_responded |= 1 << member;
+					ctx->_batch_members[ctx->_batch_count] = origin;
+					ctx->_batch_keys[ctx->_batch_count] = round_key;
+					ctx->_batch_count++;
+					if(ctx->_pending_responses > 0)
+						ctx->_pending_responses--;
+					if((ctx->_batch_count == GDH_Batch_Broadcast::ENTRIES) || (ctx->_pending_responses == 0))
+						flush_batch(ctx);
+					break;
+				}
+				round_key = ctx->gdh().insert_key(round_key);
 				Buffer* resp = TSTP::alloc(sizeof(GDH_Broadcast));
 				new (resp->frame()) GDH_Broadcast(message->group_id(), origin, round_key);
 				TSTP::marshal(resp);
-				kout << "Sending GDH Broadcast with round key(" << round_key << ") to " << origin << endl;
+				db<TSTP>(INF) << "Sending GDH Broadcast with round key(" << round_key << ") to " << origin << endl;
+				TSTP::_nic->send(resp);
+			}
+		} break;
+		case TGDH_SETUP: {
+			if(TSTP::here() != TSTP::sink()) {
+				TGDH_Setup* message = buf->frame()->data<TGDH_Setup>();
+				db<TSTP>(TRC) << "TSTP::GDH_Security::update(): TGDH SETUP message received from " << author << " with leaf = " << message->leaf() << endl;
+				if((message->members() < 2) || (message->members() > TGDH::MAX_MEMBERS) || (message->leaf() >= message->members())) {
+					db<TSTP>(WRN) << "TSTP::GDH_Security::update(): TGDH SETUP with an invalid tree dropped!" << endl;
+					break;
+				}
+				GDH_Context * ctx = context(message->group_id(), true);
+				if(!ctx)
+					break;
+				ctx->tree(TGDH(message->parameters(), message->leaf(), message->members()));
+				for(unsigned int level = 0; level < TGDH_DEPTH; level++)
+					ctx->_tree_siblings[level] = message->sibling(level);
+				ctx->_state = GDH_WAITING_FINAL;
+				set_timeout(ctx);
+				tree_announce(ctx, 0, 1, true);
+			}
+		} break;
+		case TGDH_BLINDED: {
+			TGDH_Blinded* message = buf->frame()->data<TGDH_Blinded>();
+			GDH_Context * ctx = context(message->group_id());
+			if(ctx && ctx->_node_type == GDH_TREE) {
+				db<TSTP>(TRC) << "TSTP::GDH_Security::update(): TGDH BLINDED message received" << endl;
+				unsigned int level = message->level();
+				if((level < ctx->tgdh().depth()) && (message->block() == ctx->tgdh().sibling(level))) {
+					unsigned int height = ctx->tgdh().height();
+					ctx->tgdh().sibling_key(level, message->blinded_key());
+					//newly computed secrets are passed up by the sponsors of their blocks
+					//(after a rekey the height is unchanged, since the rekeying node announces its whole path itself)
+					if(ctx->tgdh().height() > height)
+						tree_announce(ctx, height + 1, ctx->tgdh().height() + 1, true);
+					if(ctx->tgdh().ready())
+						key_ready(ctx, ctx->tgdh().key()); //final key!
+				}
+			}
+		} break;
+		case GDH_JOIN: {
+			GDH_Join* message = buf->frame()->data<GDH_Join>();
+			GDH_Context * ctx = context(message->group_id());
+			if(TSTP::here() != TSTP::sink() && ctx && ctx->_node_type == GDH_LAST) {
+				db<TSTP>(TRC) << "TSTP::GDH_Security::update(): GDH JOIN message received for " << message->joining() << endl;
+				//a fresh share keeps the joining node from deriving the current key from what it receives
+				new_key(ctx, ctx->gdh().parameters());
+				Round_Key round_key = ctx->gdh().insert_key(ctx->_round_key);
+				Buffer* resp = TSTP::alloc(sizeof(GDH_Round));
+				new (resp->frame()) GDH_Round(message->group_id(), message->joining(), round_key);
+				TSTP::marshal(resp);
 				TSTP::_nic->send(resp);
+				ctx->_node_type = GDH_INTERMEDIATE;
+			}
+		} break;
+		case GDH_REKEY: {
+			GDH_Rekey* message = buf->frame()->data<GDH_Rekey>();
+			GDH_Context * ctx = context(message->group_id());
+			if(TSTP::here() != TSTP::sink() && ctx && ((ctx->_state == GDH_WAITING_FINAL) || (ctx->_state == GDH_READY))) {
+				db<TSTP>(TRC) << "TSTP::GDH_Security::update(): GDH REKEY message received" << endl;
+				if(!message->excluded().contains(TSTP::here())) {
+					Shared_Key key = message->masked_key();
+					key ^= mask(ctx->_key, message->group_id());
+					db<TSTP>(INF) << "We received the new key!" << endl;
+					key_ready(ctx, key);
+				}
+			}
+		} break;
+		case BD_SETUP: {
+			if(TSTP::here() != TSTP::sink()) {
+				BD_Setup* message = buf->frame()->data<BD_Setup>();
+				db<TSTP>(TRC) << "TSTP::GDH_Security::update(): BD SETUP message received from " << author << " with index = " << message->index() << endl;
+				if((message->members() < 2) || (message->members() > BD_MAX_MEMBERS) || (message->index() >= message->members())) {
+					db<TSTP>(WRN) << "TSTP::GDH_Security::update(): BD SETUP with an invalid ring dropped!" << endl;
+					break;
+				}
+				GDH_Context * ctx = context(message->group_id(), true);
+				if(!ctx)
+					break;
+				ctx->burmester_desmedt(BD(message->parameters(), message->index(), message->members()));
+				ctx->_bd_group = message->group();
+				ctx->_state = GDH_WAITING_EXP; //this node is waiting for its neighbours' first round
+				set_timeout(ctx);
+				bd_round(ctx, BD_FIRST_ROUND, ctx->bd().first_round());
+			}
+		} break;
+		case BD_FIRST_ROUND: {
+			BD_Round* message = buf->frame()->data<BD_Round>();
+			GDH_Context * ctx = context(message->group_id());
+			if(ctx && ctx->_node_type == GDH_BURMESTER_DESMEDT && ctx->_state == GDH_WAITING_EXP) {
+				db<TSTP>(TRC) << "TSTP::GDH_Security::update(): BD FIRST ROUND message received" << endl;
+				if(ctx->bd().first_round(message->index(), message->round_key())) {
+					ctx->_state = GDH_WAITING_FINAL;
+					bd_round(ctx, BD_SECOND_ROUND, ctx->bd().second_round());
+				}
+			}
+		} break;
+		case BD_SECOND_ROUND: {
+			BD_Round* message = buf->frame()->data<BD_Round>();
+			GDH_Context * ctx = context(message->group_id());
+			if(ctx && ctx->_node_type == GDH_BURMESTER_DESMEDT) {
+				db<TSTP>(TRC) << "TSTP::GDH_Security::update(): BD SECOND ROUND message received" << endl;
+				if(ctx->bd().second_round(message->index(), message->round_key()))
+					key_ready(ctx, ctx->bd().key()); //final key!
+			}
+		} break;
+		case GDH_BATCH_BROADCAST: {
+			GDH_Batch_Broadcast* message = buf->frame()->data<GDH_Batch_Broadcast>();
+			GDH_Context * ctx = context(message->group_id());
+			if(TSTP::here() != TSTP::sink() && ctx && ((ctx->_state == GDH_WAITING_FINAL) || (ctx->_state == GDH_READY))) {
+				db<TSTP>(TRC) << "TSTP::GDH_Security::update(): GDH BATCH BROADCAST message received" << endl;
+				const Round_Key * round_key = message->round_key(TSTP::here());
+				if(round_key) {
+					db<TSTP>(INF) << "We calculated the final key from a batch of " << message->count() << endl;
+					key_ready(ctx, ctx->gdh().insert_key(*round_key)); //final key!
+				}
 			}
 		} break;
 		default: break;
 	}
+	_lock.unlock();
+}
+
+//Round key broadcast by the last node (or the gateway's answer to a GDH_Response)
+void TSTP::GDH_Security::chain_broadcast(GDH_Context * ctx, const Round_Key & round_key)
+{
+	if(TSTP::here() != TSTP::sink()) {
+		if(ctx->_state == GDH_WAITING_POP) {
+			Round_Key removed = ctx->gdh().remove_key(round_key);
+			Buffer* resp = TSTP::alloc(sizeof(GDH_Response));
+			new (resp->frame()) GDH_Response(ctx->id(), TSTP::sink(), removed);
+			TSTP::marshal(resp);
+			db<TSTP>(INF) << "Sending GDH Response with round key(" << removed << ") to " << TSTP::sink() << endl;
+			transmit(ctx, resp);
+			ctx->_state = GDH_WAITING_FINAL;
+		} else if((ctx->_state == GDH_WAITING_FINAL) || (ctx->_state == GDH_READY))
+			key_ready(ctx, ctx->gdh().insert_key(round_key)); //final key!
+	} else if(ctx->_state != GDH_READY) { /*gateway*/
+		ctx->_round_key = round_key; //every share but the gateway's, kept for leave_group()
+		Shared_Key key = ctx->gdh().insert_key(ctx->_round_key);
+		if(ctx->_rekey_pending) {
+			//a node has joined: the former members still hold the previous key
+			rekey(ctx, key, ctx->_members[ctx->_member_count - 1]);
+			ctx->_rekey_pending = false;
+		}
+		db<TSTP>(INF) << "Gateway calculated his final key!" << endl;
+		key_ready(ctx, key);
+	}
+}
+
+//Answers the GDH_Responses collected by the gateway with a single exponentiation pass and a single frame
+void TSTP::GDH_Security::flush_batch(GDH_Context * ctx)
+{
+    db<TSTP>(TRC) << "TSTP::GDH_Security::flush_batch(g=" << ctx->id() << ",n=" << ctx->_batch_count << ")" << endl;
+
+	ctx->gdh().insert_key(ctx->_batch_keys, ctx->_batch_count);
+
+	Buffer* resp = TSTP::alloc(sizeof(GDH_Batch_Broadcast));
+	new (resp->frame()) GDH_Batch_Broadcast(ctx->id(), ctx->_batch_members, ctx->_batch_keys, ctx->_batch_count);
+	TSTP::marshal(resp);
+	db<TSTP>(INF) << "Sending GDH Batch Broadcast with " << ctx->_batch_count << " round keys to " << resp->frame()->data<GDH_Batch_Broadcast>()->destination() << endl;
+	TSTP::_nic->send(resp);
+
+	ctx->_batch_count = 0;
 }
 
 void TSTP::GDH_Security::marshal(Buffer * buf)
@@ -493,172 +1430,10 @@ void TSTP::Security::update(NIC::Observed * obs, NIC::Protocol prot, Buffer * bu
 {
     db<TSTP>(TRC) << "TSTP::Security::update(obs=" << obs << ",buf=" << buf << ")" << endl;
 
-    if(!buf->is_microframe && buf->destined_to_me) {
-
-        switch(buf->frame()->data<Header>()->type()) {
-
-            case CONTROL: {
-                db<TSTP>(TRC) << "TSTP::Security::update(): Control message received" << endl;
-                switch(buf->frame()->data<Control>()->subtype()) {
-
-                    case DH_REQUEST: {
-                        if(TSTP::here() != TSTP::sink()) {
-                            DH_Request * dh_req = buf->frame()->data<DH_Request>();
-                            db<TSTP>(INF) << "TSTP::Security::update(): DH_Request message received: " << *dh_req << endl;
-
-                            //while(CPU::tsl(_peers_lock));
-                            //CPU::int_disable();
-                            bool valid_peer = false;
-                            for(Peers::Element * el = _pending_peers.head(); el; el = el->next())
-                                if(el->object()->valid_deploy(dh_req->origin(), TSTP::now())) {
-                                    valid_peer = true;
-                                    break;
-                                }
-                            if(!valid_peer)
-                                for(Peers::Element * el = _trusted_peers.head(); el; el = el->next())
-                                    if(el->object()->valid_deploy(dh_req->origin(), TSTP::now())) {
-                                        valid_peer = true;
-                                        _trusted_peers.remove(el);
-                                        _pending_peers.insert(el);
-                                        break;
-                                    }
-                            //_peers_lock = false;
-                            //CPU::int_enable();
-
-                            if(valid_peer) {
-                                db<TSTP>(TRC) << "TSTP::Security::update(): Sending DH_Response" << endl;
-                                // Respond to Diffie-Hellman request
-                                Buffer * resp = TSTP::alloc(sizeof(DH_Response));
-                                new (resp->frame()) DH_Response(_dh.public_key());
-                                TSTP::marshal(resp);
-                                TSTP::_nic->send(resp);
-
-                                // Calculate Master Secret
-                                Pending_Key * pk = new (SYSTEM) Pending_Key(buf->frame()->data<DH_Request>()->key());
-                                Master_Secret ms = pk->master_secret();
-                                //while(CPU::tsl(_peers_lock));
-                                //CPU::int_disable();
-                                _pending_keys.insert(pk->link());
-                                //_peers_lock = false;
-                                //CPU::int_enable();
-
-                                db<TSTP>(TRC) << "TSTP::Security::update(): Sending Auth_Request" << endl;
-                                // Send Authentication Request
-                                resp = TSTP::alloc(sizeof(Auth_Request));
-                                new (resp->frame()) Auth_Request(_auth, otp(ms, _id));
-                                TSTP::marshal(resp);
-                                TSTP::_nic->send(resp);
-                                db<TSTP>(TRC) << "Sent" << endl;
-                            }
-                        }
-                    } break;
-
-                    case DH_RESPONSE: {
-                        if(_dh_requests_open) {
-                            DH_Response * dh_resp = buf->frame()->data<DH_Response>();
-                            db<TSTP>(INF) << "TSTP::Security::update(): DH_Response message received: " << *dh_resp << endl;
-
-                            //CPU::int_disable();
-                            bool valid_peer = false;
-                            for(Peers::Element * el = _pending_peers.head(); el; el = el->next())
-                                if(el->object()->valid_deploy(dh_resp->origin(), TSTP::now())) {
-                                    valid_peer = true;
-                                    db<TSTP>(TRC) << "Valid peer found: " << *el->object() << endl;
-                                    break;
-                                }
-
-                            if(valid_peer) {
-                                _dh_requests_open--;
-                                Pending_Key * pk = new (SYSTEM) Pending_Key(buf->frame()->data<DH_Response>()->key());
-                                _pending_keys.insert(pk->link());
-                                db<TSTP>(INF) << "TSTP::Security::update(): Inserting new Pending Key: " << *pk << endl;
-                            }
-                            //CPU::int_enable();
-                        }
-                    } break;
-
-                    case AUTH_REQUEST: {
-
-                        Auth_Request * auth_req = buf->frame()->data<Auth_Request>();
-                        db<TSTP>(INF) << "TSTP::Security::update(): Auth_Request message received: " << *auth_req << endl;
-
-                        //CPU::int_disable();
-                        Peer * auth_peer = 0;
-                        for(Peers::Element * el = _pending_peers.head(); el; el = el->next()) {
-                            Peer * peer = el->object();
-
-                            if(peer->valid_request(auth_req->auth(), auth_req->origin(), TSTP::now())) {
-                                for(Pending_Keys::Element * pk_el = _pending_keys.head(); pk_el; pk_el = pk_el->next()) {
-                                    Pending_Key * pk = pk_el->object();
-                                    if(verify(pk->master_secret(), peer->id(), auth_req->otp())) {
-                                        peer->master_secret(pk->master_secret());
-                                        _pending_peers.remove(el);
-                                        _trusted_peers.insert(el);
-                                        auth_peer = peer;
-
-                                        _pending_keys.remove(pk_el);
-                                        delete pk_el->object();
-
-                                        break;
-                                    }
-                                }
-                                if(auth_peer)
-                                    break;
-                            }
-                        }
-                        //CPU::int_enable();
-
-                        if(auth_peer) {
-                            Auth encrypted_auth;
-                            encrypt(auth_peer->auth(), auth_peer, encrypted_auth);
-
-                            Buffer * resp = TSTP::alloc(sizeof(Auth_Granted));
-                            new (resp->frame()) Auth_Granted(Region::Space(auth_peer->valid().center, auth_peer->valid().radius), encrypted_auth);
-                            TSTP::marshal(resp);
-                            db<TSTP>(INF) << "TSTP::Security: Sending Auth_Granted message " << resp->frame()->data<Auth_Granted>() << endl;
-                            TSTP::_nic->send(resp);
-                        } else
-                            db<TSTP>(WRN) << "TSTP::Security::update(): No peer found" << endl;
-                    } break;
-
-                    case AUTH_GRANTED: {
-
-                        if(TSTP::here() != TSTP::sink()) {
-                            Auth_Granted * auth_grant = buf->frame()->data<Auth_Granted>();
-                            db<TSTP>(INF) << "TSTP::Security::update(): Auth_Granted message received: " << *auth_grant << endl;
-                            //CPU::int_disable();
-                            bool auth_peer = false;
-                            for(Peers::Element * el = _pending_peers.head(); el; el = el->next()) {
-                                Peer * peer = el->object();
-                                for(Pending_Keys::Element * pk_el = _pending_keys.head(); pk_el; pk_el = pk_el->next()) {
-                                    Pending_Key * pk = pk_el->object();
-                                    Auth decrypted_auth;
-                                    OTP key = otp(pk->master_secret(), peer->id());
-                                    _cipher.decrypt(auth_grant->auth(), key, decrypted_auth);
-                                    if(decrypted_auth == _auth) {
-                                        peer->master_secret(pk->master_secret());
-                                        _pending_peers.remove(el);
-                                        _trusted_peers.insert(el);
-                                        auth_peer = true;
-
-                                        _pending_keys.remove(pk_el);
-                                        delete pk_el->object();
-
-                                        break;
-                                    }
-                                }
-                                if(auth_peer)
-                                    break;
-                            }
-                            //CPU::int_enable();
-                        }
-                    } break;
-                    default: break;
-                }
-            }
-            default: break;
-        }
-    }
+    if(!buf->is_microframe && buf->destined_to_me && (buf->frame()->data<Header>()->type() == CONTROL)
+        && (buf->frame()->data<Control>()->subtype() <= AUTH_GRANTED))
+        // Pending_Keys compute their master secrets (ECDH) on demand, so key establishment runs in the Crypto_Worker
+        Crypto_Worker::submit(&process, buf);
 
     // TODO
     //if(Traits<NIC>::promiscuous && Traits<TSTP>::debugged && !buf->is_microframe) {
@@ -702,6 +1477,178 @@ void TSTP::Security::update(NIC::Observed * obs, NIC::Protocol prot, Buffer * bu
     //}
 }
 
+// Handles a key establishment message in the Crypto_Worker
+void TSTP::Security::process(Buffer * buf)
+{
+    db<TSTP>(TRC) << "TSTP::Security::process(): Control message received" << endl;
+    switch(buf->frame()->data<Control>()->subtype()) {
+
+        case DH_REQUEST: {
+            if(TSTP::here() != TSTP::sink()) {
+                DH_Request * dh_req = buf->frame()->data<DH_Request>();
+                db<TSTP>(INF) << "TSTP::Security::update(): DH_Request message received: " << *dh_req << endl;
+
+                //while(CPU::tsl(_peers_lock));
+                CPU::int_disable();
+                bool valid_peer = false;
+                for(Peers::Element * el = _pending_peers.head(); el; el = el->next())
+                    if(el->object()->valid_deploy(dh_req->origin(), TSTP::now())) {
+                        valid_peer = true;
+                        break;
+                    }
+                if(!valid_peer)
+                    for(Peers::Element * el = _trusted_peers.head(); el; el = el->next())
+                        if(el->object()->valid_deploy(dh_req->origin(), TSTP::now())) {
+                            valid_peer = true;
+                            _trusted_peers.remove(el);
+                            _pending_peers.insert(el);
+                            break;
+                        }
+                //_peers_lock = false;
+                CPU::int_enable();
+
+                if(valid_peer) {
+                    db<TSTP>(TRC) << "TSTP::Security::update(): Sending DH_Response" << endl;
+                    // Respond to Diffie-Hellman request
+                    Buffer * resp = TSTP::alloc(sizeof(DH_Response));
+                    new (resp->frame()) DH_Response(_dh.public_key());
+                    TSTP::marshal(resp);
+                    TSTP::_nic->send(resp);
+
+                    // Calculate Master Secret
+                    Pending_Key * pk = new (SYSTEM) Pending_Key(buf->frame()->data<DH_Request>()->key());
+                    Master_Secret ms = pk->master_secret();
+                    //while(CPU::tsl(_peers_lock));
+                    CPU::int_disable();
+                    _pending_keys.insert(pk->link());
+                    //_peers_lock = false;
+                    CPU::int_enable();
+
+                    db<TSTP>(TRC) << "TSTP::Security::update(): Sending Auth_Request" << endl;
+                    // Send Authentication Request
+                    resp = TSTP::alloc(sizeof(Auth_Request));
+                    new (resp->frame()) Auth_Request(_auth, otp(ms, _id));
+                    TSTP::marshal(resp);
+                    TSTP::_nic->send(resp);
+                    db<TSTP>(TRC) << "Sent" << endl;
+                }
+            }
+        } break;
+
+        case DH_RESPONSE: {
+            if(_dh_requests_open) {
+                DH_Response * dh_resp = buf->frame()->data<DH_Response>();
+                db<TSTP>(INF) << "TSTP::Security::update(): DH_Response message received: " << *dh_resp << endl;
+
+                CPU::int_disable();
+                bool valid_peer = false;
+                for(Peers::Element * el = _pending_peers.head(); el; el = el->next())
+                    if(el->object()->valid_deploy(dh_resp->origin(), TSTP::now())) {
+                        valid_peer = true;
+                        db<TSTP>(TRC) << "Valid peer found: " << *el->object() << endl;
+                        break;
+                    }
+                if(valid_peer)
+                    _dh_requests_open--;
+                CPU::int_enable();
+
+                if(valid_peer) {
+                    // The master secret (ECDH) is calculated before the key is listed, so the searches below,
+                    // which run with interrupts disabled, never calculate one
+                    Pending_Key * pk = new (SYSTEM) Pending_Key(buf->frame()->data<DH_Response>()->key());
+                    pk->master_secret();
+                    CPU::int_disable();
+                    _pending_keys.insert(pk->link());
+                    CPU::int_enable();
+                    db<TSTP>(INF) << "TSTP::Security::update(): Inserting new Pending Key: " << *pk << endl;
+                }
+            }
+        } break;
+
+        case AUTH_REQUEST: {
+
+            Auth_Request * auth_req = buf->frame()->data<Auth_Request>();
+            db<TSTP>(INF) << "TSTP::Security::update(): Auth_Request message received: " << *auth_req << endl;
+
+            // key_manager() deletes expired peers and keys with interrupts disabled, so they are only touched likewise
+            CPU::int_disable();
+            Peer * auth_peer = 0;
+            Auth encrypted_auth;
+            Region::Space destination;
+            for(Peers::Element * el = _pending_peers.head(); el; el = el->next()) {
+                Peer * peer = el->object();
+
+                if(peer->valid_request(auth_req->auth(), auth_req->origin(), TSTP::now())) {
+                    for(Pending_Keys::Element * pk_el = _pending_keys.head(); pk_el; pk_el = pk_el->next()) {
+                        Pending_Key * pk = pk_el->object();
+                        if(verify(pk->master_secret(), peer->id(), auth_req->otp())) {
+                            peer->master_secret(pk->master_secret());
+                            _pending_peers.remove(el);
+                            _trusted_peers.insert(el);
+                            auth_peer = peer;
+
+                            _pending_keys.remove(pk_el);
+                            delete pk_el->object();
+
+                            break;
+                        }
+                    }
+                    if(auth_peer)
+                        break;
+                }
+            }
+            if(auth_peer) {
+                encrypt(auth_peer->auth(), auth_peer, encrypted_auth);
+                destination = Region::Space(auth_peer->valid().center, auth_peer->valid().radius);
+            }
+            CPU::int_enable();
+
+            if(auth_peer) {
+                Buffer * resp = TSTP::alloc(sizeof(Auth_Granted));
+                new (resp->frame()) Auth_Granted(destination, encrypted_auth);
+                TSTP::marshal(resp);
+                db<TSTP>(INF) << "TSTP::Security: Sending Auth_Granted message " << resp->frame()->data<Auth_Granted>() << endl;
+                TSTP::_nic->send(resp);
+            } else
+                db<TSTP>(WRN) << "TSTP::Security::update(): No peer found" << endl;
+        } break;
+
+        case AUTH_GRANTED: {
+
+            if(TSTP::here() != TSTP::sink()) {
+                Auth_Granted * auth_grant = buf->frame()->data<Auth_Granted>();
+                db<TSTP>(INF) << "TSTP::Security::update(): Auth_Granted message received: " << *auth_grant << endl;
+                CPU::int_disable();
+                bool auth_peer = false;
+                for(Peers::Element * el = _pending_peers.head(); el; el = el->next()) {
+                    Peer * peer = el->object();
+                    for(Pending_Keys::Element * pk_el = _pending_keys.head(); pk_el; pk_el = pk_el->next()) {
+                        Pending_Key * pk = pk_el->object();
+                        Auth decrypted_auth;
+                        OTP key = otp(pk->master_secret(), peer->id());
+                        _cipher.decrypt(auth_grant->auth(), key, decrypted_auth);
+                        if(decrypted_auth == _auth) {
+                            peer->master_secret(pk->master_secret());
+                            _pending_peers.remove(el);
+                            _trusted_peers.insert(el);
+                            auth_peer = true;
+
+                            _pending_keys.remove(pk_el);
+                            delete pk_el->object();
+
+                            break;
+                        }
+                    }
+                    if(auth_peer)
+                        break;
+                }
+                CPU::int_enable();
+            }
+        } break;
+        default: break;
+    }
+}
+
 void TSTP::Security::marshal(Buffer * buf)
 {
     db<TSTP>(TRC) << "TSTP::Security::marshal(buf=" << buf << ")" << endl;
@@ -857,6 +1804,34 @@ void TSTP::update(NIC::Observed * obs, NIC::Protocol prot, Buffer * buf)
                 break;
 			case GDH_RESPONSE:
                 db<TSTP>(INF) << "TSTP::update: GDH_Response: " << *buf->frame()->data<GDH_Response>() << endl;
+                break;
+			case GDH_BATCH_BROADCAST:
+                db<TSTP>(INF) << "TSTP::update: GDH_Batch_Broadcast: " << *buf->frame()->data<GDH_Batch_Broadcast>() << endl;
+                break;
+			case GDH_CHAIN_SETUP:
+                db<TSTP>(INF) << "TSTP::update: GDH_Chain_Setup: " << *buf->frame()->data<GDH_Chain_Setup>() << endl;
+                break;
+			case GDH_MULTI_BROADCAST:
+                db<TSTP>(INF) << "TSTP::update: GDH_Multi_Broadcast: " << *buf->frame()->data<GDH_Multi_Broadcast>() << endl;
+                break;
+			case TGDH_SETUP:
+                db<TSTP>(INF) << "TSTP::update: TGDH_Setup: " << *buf->frame()->data<TGDH_Setup>() << endl;
+                break;
+			case TGDH_BLINDED:
+                db<TSTP>(INF) << "TSTP::update: TGDH_Blinded: " << *buf->frame()->data<TGDH_Blinded>() << endl;
+                break;
+			case GDH_JOIN:
+                db<TSTP>(INF) << "TSTP::update: GDH_Join: " << *buf->frame()->data<GDH_Join>() << endl;
+                break;
+			case GDH_REKEY:
+                db<TSTP>(INF) << "TSTP::update: GDH_Rekey: " << *buf->frame()->data<GDH_Rekey>() << endl;
+                break;
+			case BD_SETUP:
+                db<TSTP>(INF) << "TSTP::update: BD_Setup: " << *buf->frame()->data<BD_Setup>() << endl;
+                break;
+			case BD_FIRST_ROUND:
+			case BD_SECOND_ROUND:
+                db<TSTP>(INF) << "TSTP::update: BD_Round: " << *buf->frame()->data<BD_Round>() << endl;
                 break;
             default:
                 db<TSTP>(WRN) << "TSTP::update: Unrecognized Control subtype: " << buf->frame()->data<Control>()->subtype() << endl;
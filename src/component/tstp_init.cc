@@ -222,7 +222,12 @@ void TSTP::GDH_Security::bootstrap()
 {
     db<TSTP>(TRC) << "TSTP::GDH_Security::bootstrap()" << endl;
 
+    // The comb table is shared by every GDH, TGDH and BD object, so it is built before any of them can be used
+    GDH::precompute();
+
     TSTP::_nic->attach(this, NIC::TSTP);
+
+    Crypto_Worker::submit(&_fill_key_pool_handler);
 }
 
 void TSTP::Security::bootstrap()
@@ -254,6 +259,7 @@ void TSTP::init(const NIC & nic)
     //TSTP::Security * security = new (SYSTEM) TSTP::Security;
     TSTP * tstp = new (SYSTEM) TSTP;
 
+    Crypto_Worker::init();
     locator->bootstrap();
     timekeeper->bootstrap();
     router->bootstrap();
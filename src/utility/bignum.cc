@@ -5,6 +5,7 @@
 __BEGIN_UTIL
 
 // Class attributes
+// SECG's secp128r1 prime p = 2^128 - 2^97 - 1 (reduction() relies on it, see Bignum::SECP128R1)
 template<>
 const Bignum<16>::_Word Bignum<16>::_mod = {{ 0xff, 0xff, 0xff, 0xff,
                                               0xff, 0xff, 0xff, 0xff,
@@ -18,6 +19,16 @@ const Bignum<16>::_Barrett Bignum<16>::_barrett_u = {{ 17, 0, 0, 0,
                                                         2, 0, 0, 0,
                                                         1, 0, 0, 0}};
 
+// Montgomery constants for R = 2^128 (the modulus is -1 modulo 2^64, hence n0 = 1)
+template<>
+const Bignum<16>::_Word Bignum<16>::_montgomery_r2 = {{ 0x11, 0x00, 0x00, 0x00,
+                                                        0x08, 0x00, 0x00, 0x00,
+                                                        0x04, 0x00, 0x00, 0x00,
+                                                        0x24, 0x00, 0x00, 0x00 }};
+
+template<>
+const unsigned long long Bignum<16>::_montgomery_n0 = 1;
+
 
 // 2^(130) - 5: used by Poly1305
 template<>
@@ -27,12 +38,28 @@ const Bignum<17>::_Word Bignum<17>::_mod = {{ 0xfb, 0xff, 0xff, 0xff,
                                               0xff, 0xff, 0xff, 0xff,
                                               0x03, 0x00, 0x00, 0x00 }};
 
+// floor(base^(2 * DIGITS) / _mod) depends on the digit size here (the other constants are the same for both,
+// as the bytes that 64-bit digits add are zero)
+
 // 0x400000000000000000000000000000005000000000000000
 template<>
-const Bignum<17>::_Barrett Bignum<17>::_barrett_u = {{ 0x00, 0x00, 0x00, 0x00,
-                                                       0x00, 0x00, 0x00, 0x50,
-                                                       0x00, 0x00, 0x00, 0x00,
-                                                       0x00, 0x00, 0x00, 0x00,
-                                                       0x00, 0x00, 0x00, 0x00,
-                                                       0x00, 0x00, 0x00, 0x40 }};
+const Bignum<17, unsigned int>::_Barrett Bignum<17, unsigned int>::_barrett_u = {{ 0x00, 0x00, 0x00, 0x00,
+                                                                                   0x00, 0x00, 0x00, 0x50,
+                                                                                   0x00, 0x00, 0x00, 0x00,
+                                                                                   0x00, 0x00, 0x00, 0x00,
+                                                                                   0x00, 0x00, 0x00, 0x00,
+                                                                                   0x00, 0x00, 0x00, 0x40 }};
+
+#ifdef __SIZEOF_INT128__
+// 0x4000000000000000000000000000000050000000000000000000000000000000
+template<>
+const Bignum<17, unsigned long long>::_Barrett Bignum<17, unsigned long long>::_barrett_u = {{ 0x00, 0x00, 0x00, 0x00,
+                                                                                             0x00, 0x00, 0x00, 0x00,
+                                                                                             0x00, 0x00, 0x00, 0x00,
+                                                                                             0x00, 0x00, 0x00, 0x50,
+                                                                                             0x00, 0x00, 0x00, 0x00,
+                                                                                             0x00, 0x00, 0x00, 0x00,
+                                                                                             0x00, 0x00, 0x00, 0x00,
+                                                                                             0x00, 0x00, 0x00, 0x40 }};
+#endif
 __END_UTIL
@@ -74,8 +74,49 @@ int main()
         b.invert();
         a *= b;
         cout << "a / b = " << a << endl; // This output is parsed by tools/epossectst/eposbignumtst.py
+
+        a.randomize();
+        b.randomize();
+        cout << "a = " << a << endl; // This output is parsed by tools/epossectst/eposbignumtst.py
+        cout << "b = " << b << endl; // This output is parsed by tools/epossectst/eposbignumtst.py
+        a.to_montgomery();
+        b.to_montgomery();
+        a.montgomery_multiply(b);
+        a.from_montgomery();
+        cout << "a * b = " << a << endl; // Through the Montgomery representation. This output is parsed by tools/epossectst/eposbignumtst.py
+
+        a.randomize();
+        b = a;
+        cout << "a = " << a << endl; // This output is parsed by tools/epossectst/eposbignumtst.py
+        cout << "b = " << b << endl; // This output is parsed by tools/epossectst/eposbignumtst.py
+        a.square();
+        cout << "a * b = " << a << endl; // This output is parsed by tools/epossectst/eposbignumtst.py
+
+        a.randomize();
+        b = a;
+        cout << "a = " << a << endl; // This output is parsed by tools/epossectst/eposbignumtst.py
+        cout << "b = " << b << endl; // This output is parsed by tools/epossectst/eposbignumtst.py
+        a.to_montgomery();
+        a.montgomery_square();
+        a.from_montgomery();
+        cout << "a * b = " << a << endl; // Through the Montgomery representation. This output is parsed by tools/epossectst/eposbignumtst.py
     }
 
+    // The largest product (Modulo - 1)^2 takes every fold of a special-form reduction
+    a = 0;
+    a -= 1;
+    b = a;
+    cout << "a = " << a << endl; // This output is parsed by tools/epossectst/eposbignumtst.py
+    cout << "b = " << b << endl; // This output is parsed by tools/epossectst/eposbignumtst.py
+    a *= b;
+    cout << "a * b = " << a << endl; // This output is parsed by tools/epossectst/eposbignumtst.py
+
+    a = b;
+    cout << "a = " << a << endl; // This output is parsed by tools/epossectst/eposbignumtst.py
+    cout << "b = " << b << endl; // This output is parsed by tools/epossectst/eposbignumtst.py
+    a.square();
+    cout << "a * b = " << a << endl; // This output is parsed by tools/epossectst/eposbignumtst.py
+
     cout << "Done!" << endl; // This output is parsed by tools/epossectst/eposbignumtst.py
 
     return 0;
@@ -0,0 +1,470 @@
+/*=======================================================================*/
+/* EPOSGDHSIM.CC                                                         */
+/*                                                                       */
+/* Desc: Host-side simulator for the TSTP Group Diffie-Hellman chain     */
+/*       protocol. Runs the real Group_Diffie_Hellman arithmetic for     */
+/*       every member on top of a virtual clock and reports, for each    */
+/*       group size, the setup latency, the exponentiations and the      */
+/*       frames needed to agree on a key.                                */
+/*                                                                       */
+/* Parm: [-b bits] [-n max members] [-f frame time (us)]                 */
+/*       [-s cpu scale] [-r seed]                                        */
+/*=======================================================================*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include <group_diffie_hellman.h>
+
+using namespace EPOS;
+
+// CONSTANTS
+
+// TSTP frame layout (see include/tstp.h), in bytes, for IEEE 802.15.4
+static const unsigned int MTU = 103;
+static const unsigned int SPACE = 5;            // Region::Space
+static const unsigned int CONTROL = 1;          // sizeof(Control) - sizeof(Header)
+static const unsigned int GROUP_ID = 4;
+static const unsigned int CRC = 2;
+static const unsigned int PADDING = 3 * (sizeof(int) - 1); // worst-case alignment, messages aren't packed
+static const unsigned int CHAIN_ENTRY = 4;      // smallest delta-encoded member in a GDH_Chain_Setup
+
+// TYPES
+
+// Virtual time, in nanoseconds
+typedef unsigned long long Time;
+
+// Simulation parameters
+struct Configuration
+{
+    unsigned int bits;
+    unsigned int max_members;
+    Time frame_time;    // air time of a frame
+    double cpu_scale;   // target CPU time / host CPU time
+    unsigned int seed;
+};
+
+// Results for a group size
+struct Statistics
+{
+    unsigned int frames;
+    unsigned int exponentiations;
+    unsigned int gateway_exponentiations;
+    Time latency;
+    Time host_time;
+    bool agreed;
+};
+
+// GLOBALS
+Configuration CONFIG;
+
+__BEGIN_UTIL
+OStream::Endl endl;
+OStream::Hex hex;
+OStream::Dec dec;
+__END_UTIL
+
+// PROTOTYPES
+Time host_time();
+unsigned int frames(unsigned int bytes);
+
+template<unsigned int BITS> int run();
+
+//=============================================================================
+// SIMULATOR
+//=============================================================================
+// Node 0 is the gateway and nodes 1 to n are the chain, in order (1 is the first member, n the last one).
+// The gateway sends the GDH_Chain_Setups, the first member starts the chain with insert_key(), each intermediate
+// member inserts its key and passes the GDH_Round on, and the last one sends GDH_Multi_Broadcasts to everybody
+// else (the gateway included) plus its own GDH_Response. The other members remove their keys and answer with
+// GDH_Responses, which the gateway batches into GDH_Batch_Broadcasts for the members' final insert_key().
+// All nodes share a single loss-free channel, so frames are serialized; a node handles one message at a time
+// and the time it takes is the host time of the operation times CONFIG.cpu_scale.
+template<unsigned int BITS>
+class Simulator
+{
+private:
+    typedef Group_Diffie_Hellman<BITS> GDH;
+    typedef typename GDH::Round_Key Round_Key;
+
+    static const unsigned int KEY_SIZE = GDH::KEY_SIZE;
+
+    enum Type {
+        CHAIN_SETUP,
+        ROUND,
+        MULTI_BROADCAST,
+        RESPONSE,
+        BATCH_BROADCAST
+    };
+
+    struct Event {
+        Time time;
+        unsigned int order; // ties are delivered in sending order
+        unsigned int node;
+        unsigned int from;
+        Type type;
+        Round_Key key;
+
+        bool operator<(const Event & e) const { return (time < e.time) || ((time == e.time) && (order < e.order)); }
+    };
+
+    struct Node {
+        GDH * gdh;
+        Time busy;          // until when the CPU is taken
+        unsigned int exponentiations;
+        Round_Key key;
+        bool ready;
+    };
+
+public:
+    Simulator(unsigned int members): _members(members), _events(0), _next_order(0), _channel(0), _frames(0) {
+        _nodes = reinterpret_cast<Node *>(malloc((_members + 1) * sizeof(Node)));
+        _gdh = reinterpret_cast<GDH *>(malloc((_members + 1) * sizeof(GDH)));
+        _queue = reinterpret_cast<Event *>(malloc(QUEUE_FACTOR * (_members + 1) * sizeof(Event)));
+        _batch_nodes = reinterpret_cast<unsigned int *>(malloc(BATCH_ENTRIES * sizeof(unsigned int)));
+        _batch_keys = reinterpret_cast<Round_Key *>(malloc(BATCH_ENTRIES * sizeof(Round_Key)));
+
+        // Key pairs are drawn beforehand (as the TSTP key pool does), so they are not part of the setup latency
+        for(unsigned int i = 0; i <= _members; i++) {
+            _nodes[i].gdh = new (&_gdh[i]) GDH;
+            _nodes[i].busy = 0;
+            _nodes[i].exponentiations = 0;
+            _nodes[i].ready = false;
+        }
+    }
+
+    ~Simulator() {
+        for(unsigned int i = 0; i <= _members; i++)
+            _gdh[i].~GDH();
+        free(_batch_keys);
+        free(_batch_nodes);
+        free(_queue);
+        free(_gdh);
+        free(_nodes);
+    }
+
+    Statistics run() {
+        Time start = host_time();
+
+        _batch_count = 0;
+        _pending_responses = _members;
+
+        // GDH_Chain_Setup fragments overlap by one member
+        unsigned int listed = CHAIN_ENTRIES;
+        unsigned int fragments = 1;
+        while(listed < _members) {
+            listed += CHAIN_ENTRIES - 1;
+            fragments++;
+        }
+        Time arrival = send(0, frames(CHAIN_SETUP_SIZE + CHAIN_ENTRIES * CHAIN_ENTRY) * fragments);
+        for(unsigned int i = 1; i <= _members; i++)
+            post(arrival, i, 0, CHAIN_SETUP, Round_Key());
+
+        Time latency = 0;
+        while(_events) {
+            Event e = pop();
+            Node & node = _nodes[e.node];
+            Time now = (e.time > node.busy) ? e.time : node.busy;
+            bool ready = node.ready;
+
+            node.busy = now;
+            handle(e, now);
+
+            if(!ready && node.ready && (node.busy > latency))
+                latency = node.busy; // the key is set up when the last node gets it
+        }
+
+        Statistics stats;
+        stats.frames = _frames;
+        stats.exponentiations = 0;
+        stats.agreed = true;
+        for(unsigned int i = 0; i <= _members; i++) {
+            stats.exponentiations += _nodes[i].exponentiations;
+            stats.agreed = stats.agreed && _nodes[i].ready && (_nodes[i].key == _nodes[0].key);
+        }
+        stats.gateway_exponentiations = _nodes[0].exponentiations;
+        stats.latency = latency;
+        stats.host_time = host_time() - start;
+
+        return stats;
+    }
+
+private:
+    void handle(const Event & e, Time now) {
+        Node & node = _nodes[e.node];
+
+        switch(e.type) {
+        case CHAIN_SETUP: {
+            if(e.node == 1) {
+                Time t0 = host_time();
+                Round_Key round_key = node.gdh->insert_key();
+                now = charge(node, now, t0);
+                node.exponentiations++;
+                post(send(now, frames(ROUND_SIZE)), 2, 1, ROUND, round_key);
+            }
+        } break;
+        case ROUND: {
+            Time t0 = host_time();
+            Round_Key round_key = node.gdh->insert_key(e.key);
+            now = charge(node, now, t0);
+            node.exponentiations++;
+            if(e.node < _members) {
+                post(send(now, frames(ROUND_SIZE)), e.node + 1, e.node, ROUND, round_key);
+                break;
+            }
+
+            // Last member: GDH_Multi_Broadcasts to all the others, each frame carrying up to MULTI_ENTRIES of them
+            for(unsigned int first = 0; first < _members; first += MULTI_ENTRIES) {
+                unsigned int count = _members - first;
+                if(count > MULTI_ENTRIES)
+                    count = MULTI_ENTRIES;
+                Time arrival = send(now, frames(MULTI_SIZE + count * SPACE));
+                for(unsigned int i = first; i < first + count; i++)
+                    post(arrival, i, e.node, MULTI_BROADCAST, round_key);
+            }
+            post(send(now, frames(ROUND_SIZE)), 0, e.node, RESPONSE, e.key);
+        } break;
+        case MULTI_BROADCAST: {
+            if(e.node == 0) {
+                Time t0 = host_time();
+                node.key = node.gdh->insert_key(e.key);
+                now = charge(node, now, t0);
+                node.exponentiations++;
+                node.ready = true;
+            } else {
+                Time t0 = host_time();
+                Round_Key removed = node.gdh->remove_key(e.key);
+                now = charge(node, now, t0);
+                node.exponentiations++;
+                post(send(now, frames(ROUND_SIZE)), 0, e.node, RESPONSE, removed);
+            }
+        } break;
+        case RESPONSE: {
+            _batch_nodes[_batch_count] = e.from;
+            _batch_keys[_batch_count] = e.key;
+            _batch_count++;
+            _pending_responses--;
+            if((_batch_count == BATCH_ENTRIES) || (_pending_responses == 0)) {
+                Time t0 = host_time();
+                node.gdh->insert_key(_batch_keys, _batch_count);
+                now = charge(node, now, t0);
+                node.exponentiations += _batch_count;
+                Time arrival = send(now, frames(BATCH_SIZE + _batch_count * (SPACE + KEY_SIZE)));
+                for(unsigned int i = 0; i < _batch_count; i++)
+                    post(arrival, _batch_nodes[i], 0, BATCH_BROADCAST, _batch_keys[i]);
+                _batch_count = 0;
+            }
+        } break;
+        case BATCH_BROADCAST: {
+            Time t0 = host_time();
+            node.key = node.gdh->insert_key(e.key);
+            now = charge(node, now, t0);
+            node.exponentiations++;
+            node.ready = true;
+        } break;
+        }
+    }
+
+    // Charges the host time since t0, scaled, to the node's CPU and returns when it is done
+    Time charge(Node & node, Time now, Time t0) {
+        node.busy = now + Time((host_time() - t0) * CONFIG.cpu_scale);
+        return node.busy;
+    }
+
+    // Puts frames on the channel as soon as it is free and returns when the last one has been received
+    Time send(Time now, unsigned int n) {
+        if(_channel < now)
+            _channel = now;
+        _channel += n * CONFIG.frame_time;
+        _frames += n;
+        return _channel;
+    }
+
+    // Binary min-heap of events
+    void post(Time time, unsigned int node, unsigned int from, Type type, const Round_Key & key) {
+        if(_events == QUEUE_FACTOR * (_members + 1)) {
+            fprintf(stderr, "Error: event queue overflow!\n");
+            exit(1);
+        }
+
+        Event e;
+        e.time = time;
+        e.order = _next_order++;
+        e.node = node;
+        e.from = from;
+        e.type = type;
+        e.key = key;
+
+        unsigned int i = _events++;
+        while((i > 0) && (e < _queue[(i - 1) / 2])) {
+            _queue[i] = _queue[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+        _queue[i] = e;
+    }
+
+    Event pop() {
+        Event top = _queue[0];
+        Event last = _queue[--_events];
+
+        unsigned int i = 0;
+        for(unsigned int child = 1; child < _events; child = 2 * i + 1) {
+            if((child + 1 < _events) && (_queue[child + 1] < _queue[child]))
+                child++;
+            if(!(_queue[child] < last))
+                break;
+            _queue[i] = _queue[child];
+            i = child;
+        }
+        if(_events)
+            _queue[i] = last;
+
+        return top;
+    }
+
+private:
+    // Message sizes without their lists, and how many list entries fit in a frame (as in include/tstp.h)
+    static const unsigned int ROUND_SIZE = CONTROL + SPACE + GROUP_ID + KEY_SIZE + CRC + PADDING;
+    static const unsigned int MULTI_SIZE = CONTROL + GROUP_ID + 1 + SPACE + KEY_SIZE + CRC + PADDING;
+    static const unsigned int BATCH_SIZE = CONTROL + GROUP_ID + 1 + SPACE + CRC + PADDING;
+    static const unsigned int CHAIN_SETUP_SIZE = CONTROL + GROUP_ID + 2 * SPACE + 4 + 2 * KEY_SIZE + CRC + PADDING;
+
+    static const unsigned int MULTI_ENTRIES = (MULTI_SIZE + SPACE <= MTU) ? (MTU - MULTI_SIZE) / SPACE : 1;
+    static const unsigned int BATCH_ENTRIES = (BATCH_SIZE + SPACE + KEY_SIZE <= MTU) ? (MTU - BATCH_SIZE) / (SPACE + KEY_SIZE) : 1;
+    static const unsigned int CHAIN_ENTRIES = (CHAIN_SETUP_SIZE + 2 * CHAIN_ENTRY <= MTU) ? (MTU - CHAIN_SETUP_SIZE) / CHAIN_ENTRY : 2;
+
+    // Events pending at once: a GDH_Round or a GDH_Multi_Broadcast plus a GDH_Response or a GDH_Batch_Broadcast per node
+    static const unsigned int QUEUE_FACTOR = 4;
+
+    unsigned int _members;
+    Node * _nodes;
+    GDH * _gdh;
+    Event * _queue;
+    unsigned int _events;
+    unsigned int _next_order;
+    Time _channel;  // when the channel becomes free
+    unsigned int _frames;
+    unsigned int * _batch_nodes;
+    Round_Key * _batch_keys;
+    unsigned int _batch_count;
+    unsigned int _pending_responses;
+};
+
+// Checks the precomputed Montgomery constants of the default group against the ones computed at run time
+// (the component test only covers the groups that fit on the target, see src/component/group_diffie_hellman_test.cc)
+template<unsigned int BITS>
+class Montgomery_Check: public Group_Diffie_Hellman<BITS>
+{
+private:
+    typedef Group_Diffie_Hellman<BITS> Base;
+    typedef typename Base::Number Number;
+    typedef typename Base::Digit Digit;
+
+public:
+    static bool ok() {
+        Number q = Base::default_parameters().q();
+        Number r2, computed_r2;
+        Digit n0, computed_n0;
+        Base::montgomery_setup(r2, n0, q);
+        Base::montgomery_compute(computed_r2, computed_n0, q);
+        return (r2 == computed_r2) && (n0 == computed_n0);
+    }
+};
+
+//=============================================================================
+// MAIN
+//=============================================================================
+int main(int argc, char **argv)
+{
+    // Defaults: the group in Traits<Group_Diffie_Hellman_Parameters>, 802.15.4 frames (about 4 ms of air time
+    // at 250 kbps) and the host's own speed
+    CONFIG.bits = 32;
+    CONFIG.max_members = 4096;
+    CONFIG.frame_time = 4000 * 1000ULL;
+    CONFIG.cpu_scale = 1;
+    CONFIG.seed = time(0);
+
+    int opt;
+    while((opt = getopt(argc, argv, "b:n:f:s:r:")) != -1) {
+        switch(opt) {
+        case 'b': CONFIG.bits = atoi(optarg); break;
+        case 'n': CONFIG.max_members = atoi(optarg); break;
+        case 'f': CONFIG.frame_time = atof(optarg) * 1000; break;
+        case 's': CONFIG.cpu_scale = atof(optarg); break;
+        case 'r': CONFIG.seed = atoi(optarg); break;
+        default:
+            fprintf(stderr, "Usage: %s [-b bits] [-n max members] [-f frame time (us)] [-s cpu scale] [-r seed]\n", argv[0]);
+            return 1;
+        }
+    }
+    if((CONFIG.bits != 32) && (CONFIG.bits != 128) && (CONFIG.bits != 256) && (CONFIG.bits != 1024) && (CONFIG.bits != 1536) && (CONFIG.bits != 2048) && (CONFIG.bits != 3072)) {
+        fprintf(stderr, "Error: no default parameters for %u-bit groups (try 32, 128, 256, 1024, 1536, 2048 or 3072)!\n", CONFIG.bits);
+        return 1;
+    }
+    if(CONFIG.max_members < 2) {
+        fprintf(stderr, "Error: a chain needs at least two members!\n");
+        return 1;
+    }
+
+    // Say hello
+    printf("\nEPOS Group Diffie-Hellman simulator\n\n");
+    printf("  Group: %u bits\n", CONFIG.bits);
+    printf("  Frame time: %.3f ms\n", CONFIG.frame_time / 1e6);
+    printf("  CPU scale: %.3f\n", CONFIG.cpu_scale);
+    printf("  Seed: %u\n\n", CONFIG.seed);
+
+    Random::seed(CONFIG.seed);
+
+    switch(CONFIG.bits) {
+    case 32: return run<32>();
+    case 128: return run<128>();
+    case 256: return run<256>();
+    case 1024: return run<1024>();
+    case 1536: return run<1536>();
+    case 2048: return run<2048>();
+    default: return run<3072>();
+    }
+}
+
+//=============================================================================
+// FUNCTIONS
+//=============================================================================
+template<unsigned int BITS>
+int run()
+{
+    bool constants = Montgomery_Check<BITS>::ok();
+    printf("  Montgomery constants: %s\n\n", constants ? "OK" : "MISMATCH");
+
+    printf("  %7s %8s %9s %8s %9s %8s %12s %10s %s\n", "members", "frames", "frames/m", "exps", "exps/m", "gw exps", "latency(ms)", "host(ms)", "agreed");
+
+    bool failed = !constants;
+    for(unsigned int members = 2; members <= CONFIG.max_members; members *= 2) {
+        Simulator<BITS> simulator(members);
+        Statistics stats = simulator.run();
+
+        printf("  %7u %8u %9.2f %8u %9.2f %8u %12.3f %10.3f %s\n", members,
+               stats.frames, double(stats.frames) / members,
+               stats.exponentiations, double(stats.exponentiations) / members,
+               stats.gateway_exponentiations,
+               stats.latency / 1e6, stats.host_time / 1e6, stats.agreed ? "yes" : "NO");
+
+        failed = failed || !stats.agreed;
+    }
+
+    return failed ? 1 : 0;
+}
+
+Time host_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return Time(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+// Frames needed for a message (the ones that don't fit are fragmented)
+unsigned int frames(unsigned int bytes)
+{
+    return (bytes + MTU - 1) / MTU;
+}
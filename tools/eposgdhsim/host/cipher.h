@@ -0,0 +1,18 @@
+// EPOS GDH Simulator Host Cipher (only its key size is used, by Elliptic_Curve_Point)
+
+#ifndef __cipher_h
+#define __cipher_h
+
+#include <system/config.h>
+
+__BEGIN_SYS
+
+class Cipher
+{
+public:
+    static const unsigned int KEY_SIZE = 16;
+};
+
+__END_SYS
+
+#endif
@@ -0,0 +1,82 @@
+// EPOS GDH Simulator Host Configuration
+// Just enough of EPOS' system configuration to compile the GDH components with the host's g++
+
+#ifndef __config_h
+#define __config_h
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+
+#define __BEGIN_API             namespace EPOS {
+#define __END_API               }
+#define _API                    ::EPOS
+
+#define __BEGIN_UTIL            namespace EPOS { namespace S { namespace U {
+#define __END_UTIL              }}}
+#define __USING_UTIL            using namespace EPOS::S::U;
+#define _UTIL                   ::EPOS::S::U
+
+#define __BEGIN_SYS             namespace EPOS { namespace S {
+#define __END_SYS               }}
+#define __USING_SYS             using namespace EPOS::S;
+#define _SYS                    ::EPOS::S
+
+namespace EPOS { namespace S { namespace U {} using namespace U; } using namespace S; using namespace S::U; }
+
+#define assert(expr)            ((void)0)
+
+__BEGIN_SYS
+
+class Bignums;
+class Poly1305;
+class Diffie_Hellman;
+class Elliptic_Curve_Point;
+class Elliptic_Curve_Group_Diffie_Hellman;
+template<unsigned int BITS>
+class Group_Diffie_Hellman_Common;
+template<unsigned int BITS, unsigned int WINDOW, unsigned int TEETH>
+class Group_Diffie_Hellman;
+template<unsigned int BITS, unsigned int DEPTH, unsigned int WINDOW, unsigned int TEETH>
+class Tree_Group_Diffie_Hellman;
+template<unsigned int BITS, unsigned int MAX_MEMBERS, unsigned int WINDOW, unsigned int TEETH>
+class Burmester_Desmedt_Group_Diffie_Hellman;
+
+struct Dummy {};
+
+// All components are enabled and silent in the simulator
+template<typename T>
+struct Traits
+{
+    static const bool enabled = true;
+    static const bool debugged = false;
+    static const bool hysterically_debugged = false;
+};
+
+// Use the widest Bignum digit the host supports
+template<>
+struct Traits<Bignums>: public Traits<void>
+{
+#ifdef __SIZEOF_INT128__
+    static const unsigned int DIGIT_SIZE = 8;
+#else
+    static const unsigned int DIGIT_SIZE = 4;
+#endif
+    static const bool UNROLLED = true;
+};
+
+template<bool condition, typename Then, typename Else>
+struct IF { typedef Then Result; };
+template<typename Then, typename Else>
+struct IF<false, Then, Else> { typedef Else Result; };
+
+enum Debug_Error {ERR = 1};
+enum Debug_Warning {WRN = 2};
+enum Debug_Info {INF = 3};
+enum Debug_Trace {TRC = 4};
+
+__END_SYS
+
+#include <utility/ostream.h>
+
+#endif
@@ -0,0 +1,8 @@
+// EPOS GDH Simulator Host Memory Allocation (libc's)
+
+#ifndef __malloc_h
+#define __malloc_h
+
+#include <system/config.h>
+
+#endif
@@ -0,0 +1,63 @@
+// EPOS GDH Simulator Host OStream (on top of stdio)
+
+#ifndef __ostream_h
+#define __ostream_h
+
+#include <system/config.h>
+
+__BEGIN_UTIL
+
+class OStream
+{
+public:
+    struct Endl {};
+    struct Hex {};
+    struct Dec {};
+
+public:
+    OStream(): _hex(false) {}
+
+    OStream & operator<<(const Endl & endl) { printf("\n"); return *this; }
+    OStream & operator<<(const Hex & hex) { _hex = true; return *this; }
+    OStream & operator<<(const Dec & dec) { _hex = false; return *this; }
+
+    OStream & operator<<(char c) { printf("%c", c); return *this; }
+    OStream & operator<<(const char * s) { printf("%s", s); return *this; }
+    OStream & operator<<(bool b) { printf("%s", b ? "true" : "false"); return *this; }
+    OStream & operator<<(int i) { printf(_hex ? "%x" : "%d", i); return *this; }
+    OStream & operator<<(unsigned int i) { printf(_hex ? "%x" : "%u", i); return *this; }
+    OStream & operator<<(long i) { printf(_hex ? "%lx" : "%ld", i); return *this; }
+    OStream & operator<<(unsigned long i) { printf(_hex ? "%lx" : "%lu", i); return *this; }
+    OStream & operator<<(long long i) { printf(_hex ? "%llx" : "%lld", i); return *this; }
+    OStream & operator<<(unsigned long long i) { printf(_hex ? "%llx" : "%llu", i); return *this; }
+    OStream & operator<<(double d) { printf("%.3f", d); return *this; }
+    OStream & operator<<(const void * p) { printf("%p", p); return *this; }
+
+private:
+    bool _hex;
+};
+
+extern OStream::Endl endl;
+extern OStream::Hex hex;
+extern OStream::Dec dec;
+
+__END_UTIL
+
+__BEGIN_SYS
+
+// Debugging is compiled out in the simulator
+class Debug: public OStream {};
+
+class Null_Debug
+{
+public:
+    template<typename T>
+    Null_Debug & operator<<(const T & o) { return *this; }
+};
+
+template<typename T>
+inline Null_Debug & db(int level) { static Null_Debug d; return d; }
+
+__END_SYS
+
+#endif
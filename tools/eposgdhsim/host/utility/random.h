@@ -0,0 +1,25 @@
+// EPOS GDH Simulator Host Random Number Generator (on top of libc's)
+
+#ifndef __random_h
+#define __random_h
+
+#include <system/config.h>
+
+__BEGIN_UTIL
+
+class Random
+{
+public:
+    // rand() yields only RAND_MAX + 1 (at least 2^15, 2^31 with glibc) values, so the word is built from several calls
+    static int random() {
+        unsigned int r = 0;
+        for(unsigned int bits = 0; bits < 8 * sizeof(unsigned int); bits += 15)
+            r = (r << 15) ^ static_cast<unsigned int>(rand());
+        return r;
+    }
+    static void seed(int s) { srand(s); }
+};
+
+__END_UTIL
+
+#endif
@@ -106,15 +106,16 @@ with open(test_output, 'r') as f:
             print("mod =",mod)
             print("correct result =",expected)
 
-            expected_raw = '[' + str(expected & (0xffffffff))
+            digit_mask = (1 << (digit_size * 8)) - 1
+            expected_raw = '[' + str(expected & digit_mask)
             expected >>= (digit_size * 8)
             while expected > 0:
                 expected_raw += ', '
-                expected_raw += str(expected & (0xffffffff))
+                expected_raw += str(expected & digit_mask)
                 expected >>= (digit_size * 8)
             expected_raw += ']'
 
-            print("correct result in array form =",expected)
+            print("correct result in array form =",expected_raw)
 
 
             print("Operations parsed:")